@@ -0,0 +1,181 @@
+#include "battery.h"
+#include "storage.h"
+
+#define BATTERY_ADC_VREF    ANALOG_8
+#define BATTERY_ADC_SAMPLE  0x7  // 241 ADC clocks, 80us at 3MHz, the same as funAnalogInit()
+#define BATTERY_ADC_TRIGGER ADC_ExternalTrigConv_T2_TRGO
+
+#define CALIBRATION_MAGIC       0x43414C42  // "CALB", calibration page has been written
+#define CALIBRATION_WORD_MAGIC  0
+#define CALIBRATION_WORD_SCALE  1
+#define CALIBRATION_WORD_CUTOFF 2
+
+static volatile uint16_t battery_ring[BATTERY_SAMPLES * 2];  // Vref, battery, Vref, battery, ...
+static volatile uint8_t  battery_collapsed = 0;
+static uint32_t          battery_scale;          // Calibrated, or nominal until calibrated
+static uint32_t          battery_nominal_scale;  // Calibration sanity check
+
+// TIM2 must be running (init_pwm_aux()), it paces the scans. Blocks until the first scan (up to 5ms), which fills the
+// whole ring, so the first reading is ready right away. The nominal scale and cutoff count are only used until the
+// unit is calibrated.
+void init_battery(uint8_t adc_channel, uint32_t scale, uint16_t cutoff_vref_count)
+{
+    const volatile storage_page_t *calibration = read_storage(STORAGE_PAGE_CALIBRATION);
+
+    battery_nominal_scale = scale;
+    if (calibration->words[CALIBRATION_WORD_MAGIC] == CALIBRATION_MAGIC)
+    {
+        scale             = calibration->words[CALIBRATION_WORD_SCALE];
+        cutoff_vref_count = calibration->words[CALIBRATION_WORD_CUTOFF];
+    }
+    battery_scale = scale;
+
+    RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+    RCC->APB2PCENR |= RCC_APB2Periph_ADC1;
+    RCC->APB2PRSTR |= RCC_APB2Periph_ADC1;
+    RCC->APB2PRSTR &= ~RCC_APB2Periph_ADC1;
+
+    ADC1->SAMPTR2 = (BATTERY_ADC_SAMPLE << (3 * adc_channel)) | (BATTERY_ADC_SAMPLE << (3 * BATTERY_ADC_VREF));
+
+    // Scan Vref then the battery
+    ADC1->RSQR1 = ADC_L_0;  // 2 conversions
+    ADC1->RSQR3 = BATTERY_ADC_VREF | (adc_channel << 5);
+
+    // Analog watchdog on the Vref channel only, fires when VDD drops below the cutoff
+    ADC1->WDHTR = cutoff_vref_count;
+    ADC1->WDLTR = 0;
+    ADC1->CTLR1 = ADC_SCAN | ADC_AWDEN | ADC_AWDSGL | ADC_AWDIE | BATTERY_ADC_VREF;
+
+    ADC1->CTLR2 = ADC_ADON;
+    ADC1->CTLR2 |= CTLR2_RSTCAL_Set;
+    while (ADC1->CTLR2 & CTLR2_RSTCAL_Set)
+    {
+    }
+    ADC1->CTLR2 |= CTLR2_CAL_Set;
+    while (ADC1->CTLR2 & CTLR2_CAL_Set)
+    {
+    }
+
+    DMA1_Channel1->PADDR = (uint32_t)&ADC1->RDATAR;
+    DMA1_Channel1->MADDR = (uint32_t)battery_ring;
+    DMA1_Channel1->CNTR  = BATTERY_SAMPLES * 2;
+    DMA1_Channel1->CFGR  = DMA_CFGR1_MINC | DMA_CFGR1_CIRC | DMA_CFGR1_PSIZE_0 | DMA_CFGR1_MSIZE_0 | DMA_CFGR1_EN;
+
+    TIM2->CTLR2 = (TIM2->CTLR2 & ~TIM_MMS) | TIM_MMS_1;  // TRGO on update
+    ADC1->CTLR2 |= ADC_DMA | ADC_EXTTRIG | BATTERY_ADC_TRIGGER;
+
+    NVIC_EnableIRQ(ADC_IRQn);
+
+    while (DMA1_Channel1->CNTR > BATTERY_SAMPLES * 2 - 2)
+    {
+    }
+    for (uint8_t i = 2; i < BATTERY_SAMPLES * 2; i++)  // The next scan is 5ms away
+    {
+        battery_ring[i] = battery_ring[i & 1];
+    }
+}
+
+// 12-bit oversampled readings, see battery.h. A scan may land halfway through, the mix of old and new samples is
+// harmless for an average.
+void read_battery(uint16_t *adc_ref, uint16_t *adc_mon)
+{
+    uint16_t ref = 0;
+    uint16_t mon = 0;
+    for (uint8_t i = 0; i < BATTERY_SAMPLES * 2; i += 2)
+    {
+        ref += battery_ring[i];
+        mon += battery_ring[i + 1];
+    }
+    *adc_ref = ref >> BATTERY_DECIMATION_SHIFT;
+    *adc_mon = mon >> BATTERY_DECIMATION_SHIFT;
+}
+
+uint16_t to_battery_mv(uint16_t adc_ref, uint16_t adc_mon)
+{
+    return ((uint32_t)adc_mon * battery_scale / adc_ref) >> BATTERY_SCALE_SHIFT;
+}
+
+// Same as to_battery_mv(adc_ref, adc_mon) >= mv, without the divide, see battery.h. mv up to 4096.
+uint8_t is_battery_above(uint16_t adc_ref, uint16_t adc_mon, uint16_t mv)
+{
+    return (uint32_t)adc_mon * battery_scale >= ((uint32_t)mv * adc_ref) << BATTERY_SCALE_SHIFT;
+}
+
+// Whether a 12-bit reading is within 1/2^BATTERY_CALIBRATION_TOLERANCE_SHIFT of the nominal one.
+static uint8_t is_near_nominal(uint16_t count, uint16_t nominal_count)
+{
+    uint16_t diff = (count > nominal_count) ? count - nominal_count : nominal_count - count;
+    return ((uint32_t)diff << BATTERY_CALIBRATION_TOLERANCE_SHIFT) <= nominal_count;
+}
+
+// Powered from supply_mv (below 3.3V, see battery.h), measures the scale and the cutoff count and stores them.
+// Returns 0 and keeps the current factors if either reading is further off nominal than a part can be.
+uint8_t calibrate_battery(uint16_t supply_mv, uint16_t cutoff_mv)
+{
+    uint16_t       adc_ref;
+    uint16_t       adc_mon;
+    storage_page_t calibration;
+
+    read_battery(&adc_ref, &adc_mon);
+
+    uint32_t scale  = (((uint32_t)supply_mv * adc_ref) << BATTERY_SCALE_SHIFT) / adc_mon;
+    uint16_t cutoff = ((uint32_t)supply_mv * adc_ref + cutoff_mv * 2) / (cutoff_mv * 4);  // 12 to 10-bit
+
+    // 12-bit readings of a nominal part with VDD = supply, the battery reading does not depend on the supply then
+    uint16_t nominal_ref = ((uint32_t)BATTERY_VREF_MV * BATTERY_ADC_FULL * 4 + supply_mv / 2) / supply_mv;
+    uint16_t nominal_mon = (((uint32_t)BATTERY_VREF_MV * BATTERY_ADC_FULL * 4) << BATTERY_SCALE_SHIFT) /
+                           battery_nominal_scale;
+
+    if (!is_near_nominal(adc_ref, nominal_ref) || !is_near_nominal(adc_mon, nominal_mon))
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < STORAGE_PAGE_WORDS; i++)
+    {
+        calibration.words[i] = STORAGE_ERASED;
+    }
+    calibration.words[CALIBRATION_WORD_MAGIC]  = CALIBRATION_MAGIC;
+    calibration.words[CALIBRATION_WORD_SCALE]  = scale;
+    calibration.words[CALIBRATION_WORD_CUTOFF] = cutoff;
+    write_storage(STORAGE_PAGE_CALIBRATION, &calibration);
+
+    battery_scale = scale;
+    ADC1->WDHTR   = cutoff;
+    return 1;
+}
+
+// Reports a collapse once, the watchdog interrupt stays off afterwards.
+uint8_t get_battery_event(void)
+{
+    if (!battery_collapsed)
+    {
+        return BATTERY_NONE;
+    }
+    battery_collapsed = 0;
+    return BATTERY_COLLAPSED;
+}
+
+// Powers the ADC down for standby, between two scans so the ring stays in Vref, battery order.
+void pause_battery(void)
+{
+    ADC1->CTLR2 &= ~ADC_EXTTRIG;
+    while (DMA1_Channel1->CNTR & 1)
+    {
+    }
+    ADC1->CTLR2 &= ~ADC_ADON;
+}
+
+void resume_battery(void)
+{
+    ADC1->CTLR2 |= ADC_ADON;
+    ADC1->CTLR2 |= ADC_EXTTRIG;
+}
+
+void ADC1_IRQHandler(void) __attribute__((interrupt));
+void ADC1_IRQHandler(void)
+{
+    ADC1->CTLR1 &= ~ADC_AWDIE;  // Once is enough, power is about to be cut
+    ADC1->STATR = ~ADC_AWD;
+    battery_collapsed = 1;
+}
@@ -0,0 +1,90 @@
+#ifndef __BATTERY_H__
+#define __BATTERY_H__
+
+#include "ch32fun.h"
+
+// Battery Sampling and Hardware Cutoff
+//
+// The ADC scans the internal reference (1.2V, channel 8) and the battery divider in the background. TIM2 TRGO, the
+// 200Hz power LED frame, triggers each scan and DMA writes the results into a ring, no CPU involved.
+//
+//   TIM2 update ─┬─ Vref ─── Battery ─┬─ ... 5ms ... ─┬─ Vref ─── Battery ─┬─
+//                │  84us      84us    │               │                    │
+//   DMA ring     │ [ref mon] [ref mon] ... BATTERY_SAMPLES pairs, circular │
+//
+// Below 3.3V the LDO stops regulating and VDD follows the battery, the divider to VDD ratio no longer changes. The
+// analog watchdog therefore watches the Vref channel, whose reading rises as VDD falls:
+//
+//   Vref count = 1200mV x 1023 / VDD   | 3.3V: 372 | 3.0V: 409 | 2.8V: 438 | 2.7V: 455
+//
+// Crossing the cutoff count raises the ADC interrupt within one scan (5ms), long before the next software check.
+//
+// Oversampling and Decimation
+//
+// read_battery() sums the 64 scans in the ring (320ms of data, 64 x 1023 fits 16 bits) and shifts right by 4, 12-bit
+// results. 16 samples give 2 extra bits, the other 4x averages the noise down. It only works when the input moves by
+// more than 1 LSB between samples: the ADC noise and the LED PWM ripple on VDD and the battery do that, and TIM2
+// (200Hz) is not locked to TIM1, so each scan lands on a different ripple phase.
+//
+//   Resolution | Vref count at VDD 3.3V | Battery ratio step | Battery mV step at 4.0V
+//   10-bit     |  372                   | 1 / 372  = 0.27%   | ~11mV, the previous 8 sample average
+//   12-bit     | 1488                   | 1 / 1488 = 0.07%   | ~2.7mV
+//
+// The ratio step comes from the Vref count, the smaller of the two. Assuming ~1 LSB (10-bit) of random noise per
+// sample, the noise floor after 64 samples is 1/8 LSB, ~1.3mV at 4.0V. Static errors (Vref +-1%, divider tolerance)
+// are not reduced by averaging, calibration takes them out.
+//
+// Calibration
+//
+// Vref and the divider both vary by a few percent per part. Powered from a known supply below 3.3V, the LDO passes it
+// through, so VDD is known too and one measurement trims both (the ~5mV LDO dropout at 3mA is 0.2% at 3.0V):
+//
+//   Battery mV = Battery count x scale / Vref count >> BATTERY_SCALE_SHIFT
+//   Scale      = supply x Vref count / Battery count << BATTERY_SCALE_SHIFT
+//   Cutoff     = supply x Vref count / 4 / cutoff mV, raw 10-bit count for the analog watchdog
+//
+// The factors are stored in the calibration page, outside the firmware image, and replace the nominal ones at boot.
+// The calibration is rejected if either reading is further off nominal than the per-part spread of Vref and the divider
+// (1/16, ~6%). With VDD = supply, the battery reading is the divider ratio of full scale, whatever the supply: a supply
+// or battery above 3.3V, where the LDO regulates, reads high. The Vref reading rejects a supply far off the stated one.
+// A supply within the window is taken as stated, the click confirmation keeps a battery from calibrating by accident.
+//
+// Division-Free Thresholds
+//
+// rv32ec has no divider, every divide is a __udivsi3 call of a few hundred cycles. Threshold checks skip the mV
+// conversion and compare in the ADC domain, with floor(floor(a / b) / c) = floor(a / (b x c)):
+//
+//   to_battery_mv() >= mv  <=>  Battery count x scale >= (mv x Vref count) << BATTERY_SCALE_SHIFT
+//
+// Exact, the decisions match the 32-bit mV path for every count pair (to_battery_mv() returns 16 bits, it wraps above
+// 65V on nonsense inputs), test/test_battery.c checks it. Both sides fit 32 bits for counts up to 4095 and thresholds
+// up to 4096mV. to_battery_mv() is left for logging.
+
+#define BATTERY_SAMPLES          64  // Scans kept in the DMA ring, 4^2 x 4
+#define BATTERY_DECIMATION_SHIFT 4   // 16-bit sum to 12-bit result
+#define BATTERY_VREF_MV          1200
+#define BATTERY_ADC_FULL         1023  // Raw 10-bit conversion, the analog watchdog compares these
+#define BATTERY_SCALE_SHIFT      8     // Q8 scale, 4095 x (2000mV + 1/8) << 8 stays below 2^32
+
+#define BATTERY_CALIBRATION_TOLERANCE_SHIFT 4  // Readings within 1/16 of nominal, Vref and divider spread per part
+
+#define BATTERY_VDD_MV_TO_VREF_COUNT(mv) ((BATTERY_VREF_MV * BATTERY_ADC_FULL + (mv) / 2) / (mv))  // Compile time only
+#define BATTERY_SCALE(r_up, r_down) \
+    ((((uint32_t)BATTERY_VREF_MV * ((r_up) + (r_down))) << BATTERY_SCALE_SHIFT) / (r_down))  // Compile time only
+
+enum battery_events
+{
+    BATTERY_NONE,
+    BATTERY_COLLAPSED  // The analog watchdog saw VDD below the cutoff, reported once
+};
+
+void     init_battery(uint8_t adc_channel, uint32_t scale, uint16_t cutoff_vref_count);
+void     read_battery(uint16_t *adc_ref, uint16_t *adc_mon);
+uint16_t to_battery_mv(uint16_t adc_ref, uint16_t adc_mon);
+uint8_t  is_battery_above(uint16_t adc_ref, uint16_t adc_mon, uint16_t mv);
+uint8_t  calibrate_battery(uint16_t supply_mv, uint16_t cutoff_mv);
+uint8_t  get_battery_event(void);
+void     pause_battery(void);
+void     resume_battery(void);
+
+#endif  // __BATTERY_H__
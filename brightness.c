@@ -0,0 +1,24 @@
+#include "brightness.h"
+
+#define CIE_ROW(n)                                                                                       \
+    CIE_LIGHTNESS_TO_DUTY(n), CIE_LIGHTNESS_TO_DUTY(n + 1), CIE_LIGHTNESS_TO_DUTY(n + 2),               \
+        CIE_LIGHTNESS_TO_DUTY(n + 3), CIE_LIGHTNESS_TO_DUTY(n + 4), CIE_LIGHTNESS_TO_DUTY(n + 5),       \
+        CIE_LIGHTNESS_TO_DUTY(n + 6), CIE_LIGHTNESS_TO_DUTY(n + 7), CIE_LIGHTNESS_TO_DUTY(n + 8),       \
+        CIE_LIGHTNESS_TO_DUTY(n + 9)
+
+// L* 0-100 to PWM duty 0-1023
+//     0,   1,   2,   3,   5,   6,   7,   8,   9,  10,  12,  13,  14,  16,  18,  20,  21,  24,  26,  28,
+//    31,  33,  36,  39,  42,  45,  49,  52,  56,  60,  64,  68,  72,  77,  82,  87,  92,  98, 103, 109,
+//   ...
+//   580, 598, 617, 636, 655, 675, 696, 716, 737, 759, 781, 803, 826, 849, 872, 896, 921, 946, 971, 997,
+//  1023
+const uint16_t cie_lookup_table[BRIGHTNESS_MAX + 1] = {
+    CIE_ROW(0),  CIE_ROW(10), CIE_ROW(20), CIE_ROW(30), CIE_ROW(40),
+    CIE_ROW(50), CIE_ROW(60), CIE_ROW(70), CIE_ROW(80), CIE_ROW(90),
+    CIE_LIGHTNESS_TO_DUTY(100),
+};
+
+void set_brightness(uint8_t lightness)
+{
+    set_duty_at_next_period(cie_lookup_table[lightness]);
+}
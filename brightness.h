@@ -0,0 +1,39 @@
+#ifndef __BRIGHTNESS_H__
+#define __BRIGHTNESS_H__
+
+#include "ch32fun.h"
+#include "pwm.h"
+
+// Brightness Pipeline
+//
+//   Perceptual level -> CIE 1931 lightness L* (0-100) -> relative luminance Y (PWM duty, 0-PWM_DUTY_FULL) -> compare
+//   (mode / level)      (linear to the eye)               (cie_lookup_table, compile time)
+//
+// The compare value is written by set_duty_at_next_period().
+//
+// CIE 1931 lightness to luminance <https://en.wikipedia.org/wiki/CIELAB_color_space#From_CIELAB_to_CIEXYZ>
+//   Y = L* / 903.3               , L* <= 8
+//   Y = ((L* + 16) / 116) ^ 3    , L* >  8
+//
+// Steady levels, breathing and blinking all work in L*, so equal steps of L* look like equal steps of brightness.
+// The table is generated by the preprocessor from the formula (integer constant expressions only), there is no
+// floating point or multiplication at runtime.
+
+#define BRIGHTNESS_MAX 100  // L* = 100, full brightness
+#define BRIGHTNESS_OFF 0    // L* = 0, off
+
+// Luminance of lightness (l / s x 100) in PWM duty units, rounded.
+#define CIE_LIGHTNESS_TO_DUTY_SCALED(l, s)                                                                        \
+    ((uint16_t)((100ULL * (l) <= 8ULL * (s))                                                                      \
+                    ? (1000ULL * (l) * PWM_DUTY_FULL + 9033ULL * (s) / 2) / (9033ULL * (s))                       \
+                    : ((100ULL * (l) + 16ULL * (s)) * (100ULL * (l) + 16ULL * (s)) * (100ULL * (l) + 16ULL * (s)) \
+                           * PWM_DUTY_FULL                                                                        \
+                       + (116ULL * (s)) * (116ULL * (s)) * (116ULL * (s)) / 2)                                    \
+                          / ((116ULL * (s)) * (116ULL * (s)) * (116ULL * (s)))))
+#define CIE_LIGHTNESS_TO_DUTY(l) CIE_LIGHTNESS_TO_DUTY_SCALED(l, 100)
+
+extern const uint16_t cie_lookup_table[BRIGHTNESS_MAX + 1];
+
+void set_brightness(uint8_t lightness);
+
+#endif  // __BRIGHTNESS_H__
@@ -1,10 +1,12 @@
 #include "button.h"
 #include <stdio.h>
 
-#define BUTTON_DEBOUNCE_INTERVAL_MS   5    // 5ms
 #define BUTTON_DEBOUNCE_STABLE_CYCLES 5    // 5ms x 5 = 25ms
 #define BUTTON_RELEASE_STABLE_CYCLES  50   // 5ms x 50  = 250ms
-#define BUTTON_HOLD_STABLE_CYCLES     200  // 5ms x 200 = 1000ms
+#define BUTTON_HOLD_STABLE_CYCLES     200  // 5ms x 200 = 1000ms, default hold delay
+#define BUTTON_HOLD_REPEAT_CYCLES     0    // Default hold repeat interval, 0 - no BUTTON_HOLD_REPEAT
+#define CHORD_PRESS_WINDOW_CYCLES     20   // 5ms x 20 = 100ms, max time between the two presses of a chord
+#define CHORD_HOLD_STABLE_CYCLES      200  // 5ms x 200 = 1000ms
 
 #define printf(...) (void)0  // Disable printf to save flash
 
@@ -16,6 +18,13 @@ enum button_states
     STATE_BUTTON_RELEASE_DEBOUNCE
 };
 
+enum chord_states
+{
+    STATE_WAIT_FOR_CHORD_PRESS,
+    STATE_WAIT_FOR_CHORD_RELEASE,
+    STATE_WAIT_FOR_CHORD_IDLE
+};
+
 void init_button(button_t *button, uint8_t pin)
 {
     funPinMode(pin, GPIO_CFGLR_IN_PUPD);
@@ -24,12 +33,74 @@ void init_button(button_t *button, uint8_t pin)
     button->pin                     = pin;
     button->is_held                 = 0;
     button->hold_cycles             = 0;
+    button->repeat_cycles           = 0;
+    button->hold_delay_cycles       = BUTTON_HOLD_STABLE_CYCLES;
+    button->repeat_interval_cycles  = BUTTON_HOLD_REPEAT_CYCLES;
+    button->gestures                = BUTTON_GESTURE_MULTI_PRESS;
     button->debounce_cycles         = 0;  // Debounce cycles during stable state (pressed or released)
     button->post_release_cycles     = 0;  // Cycles after previous button release
     button->consecutive_press_count = 0;  // Count the number of presses if within the threshold
     button->state = is_button_down(button) ? STATE_WAIT_FOR_BUTTON_RELEASE : STATE_WAIT_FOR_BUTTON_PRESS;
 }
 
+// Emit the release event of the finished gesture and start over.
+static uint8_t get_release_event(button_t *button)
+{
+    uint8_t button_event = BUTTON_NONE;
+
+    if (button->is_held)
+    {
+        button->is_held = 0;
+        button_event    = BUTTON_HOLD_RELEASED;
+        printf("Emit BUTTON_HOLD_RELEASED\n");
+    }
+    else
+    {
+        switch (button->consecutive_press_count)
+        {
+            case 0:  // No button pressed
+                break;
+            case 1:
+                button_event = BUTTON_RELEASED;
+                printf("Emit BUTTON_RELEASED\n");
+                break;
+            case 2:
+                button_event = BUTTON_DOUBLE_PRESS_RELEASED;
+                printf("Emit BUTTON_DOUBLE_PRESS_RELEASED\n");
+                break;
+            case 3:
+                button_event = BUTTON_TRIPLE_PRESS_RELEASED;
+                printf("Emit BUTTON_TRIPLE_PRESS_RELEASED\n");
+                break;
+            default:  // Extend here for more consecutive presses if needed
+                button_event = BUTTON_MORE_PRESS_RELEASED;
+                printf("Emit BUTTON_MORE_PRESS_RELEASED, presses = %d\n", button->consecutive_press_count);
+                break;
+        }
+    }
+    button->consecutive_press_count = 0;
+
+    return button_event;
+}
+
+// Configure hold and autorepeat in debounce cycles (5ms).
+//   hold_delay_cycles      - Press duration until the hold event (BUTTON_HOLD, BUTTON_DOUBLE_PRESS_HOLD, ...)
+//   repeat_interval_cycles - Interval of BUTTON_HOLD_REPEAT events after the hold event, 0 disables autorepeat
+void set_button_autorepeat(button_t *button, uint16_t hold_delay_cycles, uint8_t repeat_interval_cycles)
+{
+    button->hold_delay_cycles      = hold_delay_cycles;
+    button->repeat_interval_cycles = repeat_interval_cycles;
+}
+
+// Subscribe to gestures that need to wait for the next press.
+//   BUTTON_GESTURE_MULTI_PRESS - Double/triple/more press events. Without it, every press is a single press, and
+//                                BUTTON_RELEASED / BUTTON_HOLD_RELEASED are emitted at debounced release (25ms)
+//                                instead of after BUTTON_RELEASE_STABLE_CYCLES of silence (250ms).
+void set_button_gestures(button_t *button, uint8_t gestures)
+{
+    button->gestures = gestures;
+}
+
 uint8_t get_button_event(button_t *button)
 {
     uint8_t button_event = BUTTON_NONE;
@@ -49,38 +120,7 @@ uint8_t get_button_event(button_t *button)
                 // Cycles since previous button release exceeds the cycles to confirm a release
                 if (button->post_release_cycles > BUTTON_RELEASE_STABLE_CYCLES)
                 {
-                    if (button->is_held)
-                    {
-                        button->is_held = 0;
-                        button_event    = BUTTON_HOLD_RELEASED;
-                        printf("Emit BUTTON_HOLD_RELEASED\n");
-                    }
-                    else
-                    {
-                        switch (button->consecutive_press_count)
-                        {
-                            case 0:  // No button pressed
-                                break;
-                            case 1:
-                                button_event = BUTTON_RELEASED;
-                                printf("Emit BUTTON_RELEASED\n");
-                                break;
-                            case 2:
-                                button_event = BUTTON_DOUBLE_PRESS_RELEASED;
-                                printf("Emit BUTTON_DOUBLE_PRESS_RELEASED\n");
-                                break;
-                            case 3:
-                                button_event = BUTTON_TRIPLE_PRESS_RELEASED;
-                                printf("Emit BUTTON_TRIPLE_PRESS_RELEASED\n");
-                                break;
-                            default:  // Extend here for more consecutive presses if needed
-                                button_event = BUTTON_MORE_PRESS_RELEASED;
-                                printf("Emit BUTTON_MORE_PRESS_RELEASED, presses = %d\n",
-                                       button->consecutive_press_count);
-                                break;
-                        }
-                    }
-                    button->consecutive_press_count = 0;
+                    button_event = get_release_event(button);
                 }
             }
             break;
@@ -127,17 +167,44 @@ uint8_t get_button_event(button_t *button)
             }
             break;
         case STATE_WAIT_FOR_BUTTON_RELEASE:
-            ++button->hold_cycles;
+            if (button->hold_cycles < UINT16_MAX)  // Saturate, hold event is emitted only once per press
+            {
+                ++button->hold_cycles;
+            }
             if (is_button_down(button))  // Not released yet
             {
-                // Emit hold event if no consecutive press and exceeded hold threshold.
-                // Note: Hold event is only emitted once. To continuously emitting hold event, extend here.
-                if (button->consecutive_press_count < 2  // 0 - Hold on power on. 1 - Press and hold after power on.
-                    && (button->is_held != 1 && button->hold_cycles >= BUTTON_HOLD_STABLE_CYCLES))
+                // Emit hold event once the hold delay is reached, the event tells how many presses came before it.
+                // Then emit hold repeat events every repeat interval until the button is released.
+                if (button->hold_cycles == button->hold_delay_cycles)
+                {
+                    button->is_held       = 1;
+                    button->repeat_cycles = 0;
+                    switch (button->consecutive_press_count)
+                    {
+                        case 0:  // Hold on power on
+                        case 1:  // Press and hold
+                            button_event = BUTTON_HOLD;
+                            printf("Emit BUTTON_HOLD\n");
+                            break;
+                        case 2:
+                            button_event = BUTTON_DOUBLE_PRESS_HOLD;
+                            printf("Emit BUTTON_DOUBLE_PRESS_HOLD\n");
+                            break;
+                        case 3:
+                            button_event = BUTTON_TRIPLE_PRESS_HOLD;
+                            printf("Emit BUTTON_TRIPLE_PRESS_HOLD\n");
+                            break;
+                        default:  // Extend here for more consecutive presses if needed
+                            button_event = BUTTON_MORE_PRESS_HOLD;
+                            printf("Emit BUTTON_MORE_PRESS_HOLD, presses = %d\n", button->consecutive_press_count);
+                            break;
+                    }
+                }
+                else if (button->hold_cycles > button->hold_delay_cycles && button->repeat_interval_cycles != 0 &&
+                         ++button->repeat_cycles >= button->repeat_interval_cycles)
                 {
-                    button->is_held = 1;
-                    button_event    = BUTTON_HOLD;
-                    printf("Emit BUTTON_HOLD\n");
+                    button->repeat_cycles = 0;
+                    button_event          = BUTTON_HOLD_REPEAT;
                 }
             }
             else  // released
@@ -154,6 +221,11 @@ uint8_t get_button_event(button_t *button)
                 // Release stabilized. Reset post release cycles and start counting for consecutive press detection.
                 if (button->debounce_cycles >= BUTTON_DEBOUNCE_STABLE_CYCLES)
                 {
+                    // Without multi press gestures there is no next press to wait for, emit the release immediately.
+                    if (!(button->gestures & BUTTON_GESTURE_MULTI_PRESS))
+                    {
+                        button_event = get_release_event(button);
+                    }
                     button->post_release_cycles = 0;
                     button->state               = STATE_WAIT_FOR_BUTTON_PRESS;
                     // printf("STATE_WAIT_FOR_BUTTON_PRESS\n");
@@ -170,12 +242,102 @@ uint8_t get_button_event(button_t *button)
     return button_event;
 }
 
-void debounce_delay(void)
+uint8_t is_button_down(button_t *button)
+{
+    return funDigitalRead(button->pin) == FUN_LOW;
+}
+
+// Debounced button state, does not read GPIO.
+uint8_t is_button_pressed(button_t *button)
 {
-    Delay_Ms(BUTTON_DEBOUNCE_INTERVAL_MS);
+    return button->state == STATE_WAIT_FOR_BUTTON_RELEASE || button->state == STATE_BUTTON_RELEASE_DEBOUNCE;
 }
 
-uint8_t is_button_down(button_t *button)
+// Released and no gesture in progress, nothing to emit until the next press.
+uint8_t is_button_idle(button_t *button)
 {
-    return funDigitalRead(button->pin) == FUN_LOW;
+    return button->state == STATE_WAIT_FOR_BUTTON_PRESS && button->consecutive_press_count == 0 && !button->is_held;
+}
+
+// Drop the gesture in progress, no release or hold events are emitted for it.
+static void cancel_button_gesture(button_t *button)
+{
+    button->is_held                 = 0;
+    button->consecutive_press_count = 0;
+}
+
+void init_chord(chord_t *chord, button_t *first, button_t *second)
+{
+    chord->first       = first;
+    chord->second      = second;
+    chord->is_held     = 0;
+    chord->hold_cycles = 0;
+    // Both held on power on is not a chord, wait until both are released.
+    chord->state = (is_button_pressed(first) && is_button_pressed(second)) ? STATE_WAIT_FOR_CHORD_IDLE
+                                                                           : STATE_WAIT_FOR_CHORD_PRESS;
+}
+
+// Call after get_button_event() of both buttons with their events, suppressed events are replaced by BUTTON_NONE.
+uint8_t get_chord_event(chord_t *chord, uint8_t *first_event, uint8_t *second_event)
+{
+    uint8_t chord_event = CHORD_NONE;
+
+    switch (chord->state)
+    {
+        case STATE_WAIT_FOR_CHORD_PRESS:
+            // hold_cycles counts from the debounced press, both presses must be within the window
+            if (is_button_pressed(chord->first) && is_button_pressed(chord->second) &&
+                chord->first->hold_cycles <= CHORD_PRESS_WINDOW_CYCLES &&
+                chord->second->hold_cycles <= CHORD_PRESS_WINDOW_CYCLES)
+            {
+                chord->is_held     = 0;
+                chord->hold_cycles = 0;
+                chord->state       = STATE_WAIT_FOR_CHORD_RELEASE;
+                chord_event        = CHORD_PRESSED;
+                printf("Emit CHORD_PRESSED\n");
+            }
+            else
+            {
+                return CHORD_NONE;  // Not a chord, keep button events
+            }
+            break;
+        case STATE_WAIT_FOR_CHORD_RELEASE:
+            if (is_button_pressed(chord->first) && is_button_pressed(chord->second))
+            {
+                if (++chord->hold_cycles == CHORD_HOLD_STABLE_CYCLES)
+                {
+                    chord->is_held = 1;
+                    chord_event    = CHORD_HOLD;
+                    printf("Emit CHORD_HOLD\n");
+                }
+            }
+            else
+            {
+                chord->state = STATE_WAIT_FOR_CHORD_IDLE;
+            }
+            break;
+        case STATE_WAIT_FOR_CHORD_IDLE:
+            if (!is_button_pressed(chord->first) && !is_button_pressed(chord->second))
+            {
+                if (chord->is_held)
+                {
+                    chord_event = CHORD_HOLD_RELEASED;
+                    printf("Emit CHORD_HOLD_RELEASED\n");
+                }
+                else
+                {
+                    chord_event = CHORD_RELEASED;
+                    printf("Emit CHORD_RELEASED\n");
+                }
+                chord->state = STATE_WAIT_FOR_CHORD_PRESS;
+            }
+            break;
+    }
+
+    cancel_button_gesture(chord->first);
+    cancel_button_gesture(chord->second);
+    *first_event  = BUTTON_NONE;
+    *second_event = BUTTON_NONE;
+
+    return chord_event;
 }
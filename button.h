@@ -14,7 +14,8 @@
 //  +-------------------------------+         +-------------------------------+
 //  | STATE_BUTTON_RELEASE_DEBOUNCE |         | STATE_WAIT_FOR_BUTTON_RELEASE |
 //  | - Debouncing button release   | <-----> | - Wait for button release     |
-//  |                               |         | - Emit BUTTON_HOLD event      |
+//  |                               |         | - Emit BUTTON_*HOLD events    |
+//  |                               |         | - Emit BUTTON_HOLD_REPEAT     |
 //  +-------------------------------+         +-------------------------------+
 
 enum button_events
@@ -29,23 +30,73 @@ enum button_events
     BUTTON_MORE_PRESSED,         // More than 3 consecutive presses
     BUTTON_MORE_PRESS_RELEASED,  // More than 3 consecutive press releases
     BUTTON_HOLD,
+    BUTTON_DOUBLE_PRESS_HOLD,  // Click, then press and hold
+    BUTTON_TRIPLE_PRESS_HOLD,  // Double click, then press and hold
+    BUTTON_MORE_PRESS_HOLD,    // More than 2 clicks, then press and hold
+    BUTTON_HOLD_REPEAT,        // Autorepeat while the button is still held after any hold event
     BUTTON_HOLD_RELEASED
 };
 
+// Chord Lifecycle States, both buttons pressed together
+//  +-------------------------------+         +-------------------------------+         +-----------------------------+
+//  |  STATE_WAIT_FOR_CHORD_PRESS   |         |  STATE_WAIT_FOR_CHORD_RELEASE |         |  STATE_WAIT_FOR_CHORD_IDLE  |
+//  |  - Both pressed within window | ------> |  - Emit CHORD_PRESSED event   | ------> |  - Wait for both released   |
+//  |                               |         |  - Emit CHORD_HOLD event      |         |  - Emit CHORD_*RELEASED     |
+//  +-------------------------------+         +-------------------------------+         +-----------------------------+
+//                  ^                                                                                  |
+//                  +----------------------------------------------------------------------------------+
+//
+// The chord runs on the debounced button states, it does not read GPIO. Once a chord is detected, all events of both
+// buttons are suppressed until both are released, the gesture in progress on each button is cancelled. Only the
+// BUTTON_PRESSED of the first button, emitted before the second button is down, gets through.
+
+enum chord_events
+{
+    CHORD_NONE,
+    CHORD_PRESSED,
+    CHORD_RELEASED,  // Released without hold
+    CHORD_HOLD,
+    CHORD_HOLD_RELEASED
+};
+
+#define BUTTON_DEBOUNCE_INTERVAL_MS 5  // get_button_event() is called every 5ms, all cycle counts are in 5ms steps
+
+// Gesture subscription mask
+#define BUTTON_GESTURE_NONE        0x00
+#define BUTTON_GESTURE_MULTI_PRESS 0x01  // Double/triple/more press events, delays release events by 250ms
+
 typedef struct button
 {
     uint8_t  pin;
     uint8_t  state;
+    uint8_t  gestures;
     uint8_t  is_held;
     uint16_t hold_cycles;
+    uint16_t hold_delay_cycles;
+    uint8_t  repeat_cycles;
+    uint8_t  repeat_interval_cycles;
     uint16_t debounce_cycles;
     uint8_t  consecutive_press_count;
     uint32_t post_release_cycles;
 } button_t;
 
+typedef struct chord
+{
+    button_t *first;
+    button_t *second;
+    uint8_t   state;
+    uint8_t   is_held;
+    uint16_t  hold_cycles;
+} chord_t;
+
 void    init_button(button_t *button, uint8_t pin);
+void    set_button_autorepeat(button_t *button, uint16_t hold_delay_cycles, uint8_t repeat_interval_cycles);
+void    set_button_gestures(button_t *button, uint8_t gestures);
 uint8_t get_button_event(button_t *button);
-void    debounce_delay(void);
 uint8_t is_button_down(button_t *button);
+uint8_t is_button_pressed(button_t *button);
+uint8_t is_button_idle(button_t *button);
+void    init_chord(chord_t *chord, button_t *first, button_t *second);
+uint8_t get_chord_event(chord_t *chord, uint8_t *first_event, uint8_t *second_event);
 
 #endif  // __BUTTON_H__
@@ -0,0 +1,39 @@
+#include "candle.h"
+#include "brightness.h"
+
+#define CANDLE_LFSR_TAPS     0xB400  // x^16 + x^14 + x^13 + x^11 + 1, maximal length 65535
+#define CANDLE_LFSR_SEED     0xACE1  // Any nonzero value
+#define CANDLE_LOWPASS_SHIFT 2       // alpha = 1/4, fc = alpha x 100Hz / 2pi = ~4Hz
+#define CANDLE_DEPTH_SHIFT   2       // Noise +-128 -> +-32 L*, standard deviation ~10 L*
+#define CANDLE_LIGHTNESS_MIN 1       // Never goes out
+
+static uint16_t candle_lfsr     = CANDLE_LFSR_SEED;
+static uint16_t candle_filtered = 128 << 8;  // 8.8 fixed point, starts at the middle of the noise range
+
+// An all-zero LFSR would stay zero, any other seed is fine.
+void init_candle(uint16_t seed)
+{
+    candle_lfsr     = seed ? seed : CANDLE_LFSR_SEED;
+    candle_filtered = 128 << 8;
+}
+
+// One 100Hz step, returns the flickering CIE L* around lightness.
+uint8_t step_candle(uint8_t lightness)
+{
+    candle_lfsr = (candle_lfsr >> 1) ^ (-(candle_lfsr & 1) & CANDLE_LFSR_TAPS);
+
+    // The low byte is the last 8 output bits of the LFSR, uniform 0-255
+    int32_t noise = (candle_lfsr & 0xFF) << 8;
+    candle_filtered += (noise - candle_filtered) >> CANDLE_LOWPASS_SHIFT;
+
+    int32_t flicker = lightness + (((int32_t)(candle_filtered >> 8) - 128) >> CANDLE_DEPTH_SHIFT);
+    if (flicker < CANDLE_LIGHTNESS_MIN)
+    {
+        return CANDLE_LIGHTNESS_MIN;
+    }
+    if (flicker > BRIGHTNESS_MAX)
+    {
+        return BRIGHTNESS_MAX;
+    }
+    return flicker;
+}
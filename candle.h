@@ -0,0 +1,20 @@
+#ifndef __CANDLE_H__
+#define __CANDLE_H__
+
+#include "ch32fun.h"
+
+// Candle Flicker
+//
+//   16-bit Galois LFSR -> 8-bit white noise -> one-pole lowpass (8.8 fixed point) -> +- CIE L* around the level
+//   (taps 0xB400)                              (y += (x - y) >> 2, ~4Hz at 100Hz)    (clamped to 1 - BRIGHTNESS_MAX)
+//
+// Called at 100Hz from the pattern timer. Shifts, adds and XORs only, about 20 instructions per step on rv32ec (no
+// multiply), the output goes through set_brightness() like every other mode, so the flicker is gamma corrected.
+// The lowpass leaves a slow, wandering flame with the occasional deep dip, the top is clipped at full brightness.
+
+#define CANDLE_STEP_MS 10  // 100Hz
+
+void    init_candle(uint16_t seed);
+uint8_t step_candle(uint8_t lightness);
+
+#endif  // __CANDLE_H__
@@ -9,167 +9,166 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ch32fun.h"
+#include "battery.h"
+#include "brightness.h"
 #include "button.h"
-
-#define PIN_POWER_LED     PC1       // Power LED pin
-#define PIN_LATCH         PC2       // Latch pin
-#define PIN_MODE_BUTTON   PC2       // Mode button pin, same as latch pin
-#define PIN_LEVEL_BUTTON  PA2       // Set button pin
-#define PIN_PWM           PC4       // PWM output pin
-#define PIN_POWER_MONITOR PD6       // Power monitoring pin
-#define ADC_POWER_MONITOR ANALOG_6  // Power monitoring ADC channel A6 (PD6)
-
-#define POWER_MONITORING_CYCLES     1000  // Every 5 seconds - button_debounce() = 5ms
+#include "candle.h"
+#include "indicator.h"
+#include "latch.h"
+#include "levels.h"
+#include "lockout.h"
+#include "patterns.h"
+#include "pwm.h"
+#include "rhythm.h"
+#include "standby.h"
+#include "timer.h"
+
+#define PIN_POWER_LED     PC1        // Power LED pin
+#define PIN_MODE_BUTTON   PIN_LATCH  // Mode button pin, same as latch pin
+#define PIN_LEVEL_BUTTON  PA2        // Set button pin
+#define PIN_POWER_MONITOR PD6        // Power monitoring pin
+#define ADC_POWER_MONITOR ANALOG_6   // Power monitoring ADC channel A6 (PD6)
+
+#define POWER_MONITORING_MS         5000  // Every 5 seconds
 #define POWER_VOLT_DIV_R_UP         2     // 22k or 10k   | 2:3 voltage divider
 #define POWER_VOLT_DIV_R_DOWN       3     // 33k or 15k   | 5.5V / 5 x 3 = 3.3V
 #define POWER_LOW_VOLT_THRESHOLD_MV 3000  // 3.0V
-#define POWER_LOW_COUNT_THRESHOLD   3     // 3 times
+#define POWER_LOW_COUNT_THRESHOLD   3     // 3 times, soft shutdown with the indicator pattern
+#define POWER_CUTOFF_VOLT_MV        2800  // 2.8V, hard cutoff by the ADC analog watchdog, see battery.h
+#define POWER_BARS_4_VOLT_MV        3900  // State of charge shown by the power indicator
+#define POWER_BARS_3_VOLT_MV        3700
+#define POWER_BARS_2_VOLT_MV        3450
 
-#define PWM_FREQUENCY              ((uint32_t)60 * 1000)                        // 60kHz
-#define PWM_CLOCKS_FULL_DUTY_CYCLE (FUNCONF_SYSTEM_CORE_CLOCK / PWM_FREQUENCY)  // 100% duty cycle
-#define PWM_CLOCKS_ZERO_DUTY_CYCLE 0                                            // 0% duty cycle
 #define PWM_SEQUENCE_ON            1
 #define PWM_SEQUENCE_OFF           0
 #define PWM_SEQUENCE_INCREASE      1
 #define PWM_SEQUENCE_DECREASE      0
+#define PWM_SEQUENCE_STANDBY       2  // Beacon flash is over and the LED is off, ready for standby
+
+#define LEVEL_BUTTON_HOLD_DELAY_CYCLES 100  // 5ms x 100 = 500ms until ramping starts
+#define LEVEL_BUTTON_REPEAT_CYCLES     3    // 5ms x 3 = 15ms, ~66 ramp steps per second
+
+#define CALIBRATION_SUPPLY_MV       3000  // Factory calibration supply, below the 3.3V LDO output so VDD is known too
+#define CALIBRATION_HOLD_MS         3000  // Level button held this long at power on arms calibration
+#define CALIBRATION_CLICKS          5     // Then exactly this many Level clicks confirm it
+#define CALIBRATION_CLICKS_MS       3000  // Within this window after the hold
+#define CALIBRATION_DEBOUNCE_CYCLES 4     // 5ms x 4 = 20ms at the other level to count as a press or release
+#define CALIBRATION_CONFIRM_MS      1000  // Power LED on after an accepted calibration
 
 #define MORSE_CODE_DIT_DURATION_MS 150  // 100ms
 
+#define STROBE_PULSE_US  2000  // 4% on at 20Hz, 1% at 5Hz, leaves room for the SGM3732 soft-start of each pulse
+
+#define BEACON_FLASH_MS  20  // Full brightness flash between standby periods
+#define BEACON_SETTLE_MS 1   // LED off for a full PWM period (max 267us) before TIM1 stops in standby
+
 // #define printf(...) (void)0  // Disable printf to save flash
 
 enum light_modes
 {
     MODE_STEADY,
+    MODE_MOONLIGHT,
+    MODE_CANDLE,
     MODE_BREATHING,
     MODE_BLINKING,
+    MODE_STROBE,
+    MODE_BEACON,
+    MODE_RHYTHM,
     MODE_SOS,
     MODE_OFF
 };
 
-const char* mode_names[] = {"MODE_STEADY", "MODE_BREATHING", "MODE_BLINKING", "MODE_SOS"};
+const char* mode_names[] = {"MODE_STEADY", "MODE_MOONLIGHT", "MODE_CANDLE", "MODE_BREATHING", "MODE_BLINKING",
+                            "MODE_STROBE", "MODE_BEACON", "MODE_RHYTHM", "MODE_SOS", "MODE_OFF"};
 
-uint8_t  current_mode           = 0;     // 5 modes: brightness, blink, dimming, sos, off
-uint8_t  current_level          = 0;     // 0-7 levels of brightness, blink speed, dimming speed.
-uint16_t current_pwm_duty_cycle = 0;     // Lights off
-uint32_t pwm_update_interval_ms = 1000;  // systick interval in ms, set before initialize systick.
-uint8_t  pwm_sequence           = 0;     // 0 - off / decrease; 1 - on / increase; 0-31 - sos sequence
+uint8_t      current_mode       = 0;  // light_modes, MODE_OFF only while powering off
+uint8_t      current_level      = 0;  // 0-LEVEL_MAX levels of brightness, blink speed, dimming speed.
+uint8_t      current_brightness = 0;  // CIE L* 0-100, lights off
+uint8_t      pwm_sequence       = 0;  // 0 - off / decrease; 1 - on / increase; step of a packed pattern
+uint8_t      ramp_direction     = PWM_SEQUENCE_INCREASE;  // Steady mode ramp, reversed on each hold
+uint8_t      is_ramping         = 0;                      // From a plain hold until release or the next level change
+uint8_t      current_signal     = SIGNAL_SOS;             // Distress signal sent in SOS mode
+soft_timer_t pattern_timer;                               // Steps the pattern, period from the level table
 
-void systick_init(void)
-{
-    SysTick->CTLR = 0;
-    NVIC_EnableIRQ(SysTicK_IRQn);
-    SysTick->CMP  = FUNCONF_SYSTEM_CORE_CLOCK / 1000 * pwm_update_interval_ms;
-    SysTick->CNT  = 0;
-    SysTick->CTLR = SYSTICK_CTLR_STE | SYSTICK_CTLR_STIE | SYSTICK_CTLR_STCLK;
-}
-
-// Gamma brightness lookup table <https://victornpb.github.io/gamma-table-generator>
-// gamma = 2.00 steps = 100 range = 0-1023
-const uint16_t gamma_lookup_table[100] = {
-    0,   0,   0,   1,   2,   3,   4,   5,   7,   8,   10,  13,  15,  18,  20,  23,  27,  30,  34,   38,
-    42,  46,  51,  55,  60,  65,  71,  76,  82,  88,  94,  100, 107, 114, 121, 128, 135, 143, 151,  159,
-    167, 175, 184, 193, 202, 211, 221, 231, 240, 251, 261, 271, 282, 293, 304, 316, 327, 339, 351,  363,
-    376, 388, 401, 414, 428, 441, 455, 469, 483, 497, 511, 526, 541, 556, 572, 587, 603, 619, 635,  651,
-    668, 685, 702, 719, 736, 754, 772, 790, 808, 827, 845, 864, 883, 903, 922, 942, 962, 982, 1002, 1023,
-};
+const level_t level_table[LEVEL_COUNT] = {LEVEL_TABLE};
 
-void disable_systick(void)
+void step_packed_pattern(const pattern_t* pattern)
 {
-    NVIC_DisableIRQ(SysTicK_IRQn);
+    set_brightness(is_pattern_on(pattern, pwm_sequence) ? BRIGHTNESS_MAX : BRIGHTNESS_OFF);
+    if (++pwm_sequence >= pattern->length)
+    {
+        pwm_sequence = 0;
+    }
 }
 
-void SysTick_Handler(void) __attribute__((interrupt));
-void SysTick_Handler(void)
+void step_pattern(void)
 {
-    SysTick->CMP += FUNCONF_SYSTEM_CORE_CLOCK / 1000 * pwm_update_interval_ms;
-    SysTick->SR = 0;
-
-    // process mode and level changes
     switch (current_mode)
     {
+        case MODE_CANDLE:
+            set_brightness(step_candle(current_brightness));
+            break;
         case MODE_BREATHING:
-            TIM1->CH4CVR = PWM_CLOCKS_FULL_DUTY_CYCLE * gamma_lookup_table[current_pwm_duty_cycle] / 1023;
-            (pwm_sequence == PWM_SEQUENCE_INCREASE) ? current_pwm_duty_cycle++ : current_pwm_duty_cycle--;
-            if (current_pwm_duty_cycle >= 100 || current_pwm_duty_cycle <= 0)
+            set_brightness(current_brightness);
+            (pwm_sequence == PWM_SEQUENCE_INCREASE) ? current_brightness++ : current_brightness--;
+            if (current_brightness >= BRIGHTNESS_MAX || current_brightness <= BRIGHTNESS_OFF)
             {
                 pwm_sequence = !pwm_sequence;
             }
             break;
         case MODE_BLINKING:
-            TIM1->CH4CVR = (pwm_sequence == PWM_SEQUENCE_ON) ? PWM_CLOCKS_FULL_DUTY_CYCLE : PWM_CLOCKS_ZERO_DUTY_CYCLE;
-            pwm_sequence = !pwm_sequence;
+            step_packed_pattern(&blink_pattern);
             break;
-        case MODE_SOS:
-            // From Wikipedia:
-            // > The duration of a dah is three times the duration of a dit. Each dit or dah within an encoded character
-            // > is followed by a period of signal absence, called a space, equal to the dit duration.
-            // SOS Morse Code is the following sequence under a fixed systick.
-            //   Morse Code - . . . --- --- --- . . . <-Wait->  | SOS   Time   = 0.15s x 24 = 3.6s
-            //       Binary - 10101011101110111010101000000000  | Pause Time   = 0.15s x  8 = 1.2s
-            //                |----+----|----+----|----+----|-  | Total Time   = 0.15s x 32 = 4.8s
-            //     Sequence - 0    5   10   15   20   25   30   | No. Sequence = 32
-            //           On - 0 2 4 678 012 456 8 0 2           | On  Sequence = 15
-            //          Off -  1 3 5   9   3   7 9 1 345678901  | Off Sequence = 17
-            TIM1->CH4CVR = (pwm_sequence >= 23 ||
-                            ((pwm_sequence & 0x1) && pwm_sequence != 7 && pwm_sequence != 11 && pwm_sequence != 15))
-                               ? PWM_CLOCKS_ZERO_DUTY_CYCLE
-                               : PWM_CLOCKS_FULL_DUTY_CYCLE;
-
-            pwm_update_interval_ms = MORSE_CODE_DIT_DURATION_MS;
-
-            pwm_sequence++;
-            pwm_sequence &= 0x1F;  // pwm_sequence %= 32;
+        case MODE_BEACON:
+            if (pwm_sequence == PWM_SEQUENCE_ON)  // Flash is over
+            {
+                set_brightness(BRIGHTNESS_OFF);
+                pwm_sequence = PWM_SEQUENCE_OFF;
+                start_timer(&pattern_timer, BEACON_SETTLE_MS, 0);
+            }
+            else
+            {
+                pwm_sequence = PWM_SEQUENCE_STANDBY;
+            }
+            break;
+        case MODE_RHYTHM:
+        {
+            uint8_t  is_on;
+            uint16_t run_ms = next_rhythm_run(&is_on);
+            set_brightness(is_on ? BRIGHTNESS_MAX : BRIGHTNESS_OFF);
+            start_timer(&pattern_timer, run_ms, 0);  // One-shot per run, no work in between
+            break;
+        }
+        case MODE_SOS:  // See patterns.h for the Morse code bit strings
+            step_packed_pattern(&signal_patterns[current_signal]);
             break;
     }
 }
 
-void tim1_pwm_init(void)
+void start_beacon_flash(void)
 {
-    // Enable GPIOC and TIM1
-    RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_TIM1;
-
-    // PC4 is T1CH4, 10MHz Output alt func, push-pull
-    GPIOC->CFGLR &= ~(0xf << (4 * 4));
-    GPIOC->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * 4);
-
-    // Reset TIM1 to init all regs
-    RCC->APB2PRSTR |= RCC_APB2Periph_TIM1;
-    RCC->APB2PRSTR &= ~RCC_APB2Periph_TIM1;
-
-    // Prescaler
-    TIM1->PSC = 0x0000;
-
-    // Auto Reload - sets period
-    TIM1->ATRLR = PWM_CLOCKS_FULL_DUTY_CYCLE - 1;
-
-    // Reload immediately
-    TIM1->SWEVGR |= TIM_UG;
-
-    // Enable CH4 output, positive pol
-    TIM1->CCER |= TIM_CC4E | TIM_CC4NP;
-
-    // CH2 Mode is output, PWM1 (CC1S = 00, OC1M = 110)
-    TIM1->CHCTLR2 |= TIM_OC4M_2 | TIM_OC4M_1;
-
-    // Set the Capture Compare Register value to 0% initially
-    TIM1->CH4CVR = PWM_CLOCKS_ZERO_DUTY_CYCLE;
-
-    // Enable TIM1 outputs
-    TIM1->BDTR |= TIM_MOE;
-
-    // Enable TIM1
-    TIM1->CTLR1 |= TIM_CEN;
+    pwm_sequence = PWM_SEQUENCE_ON;
+    set_brightness(BRIGHTNESS_MAX);
+    start_timer(&pattern_timer, BEACON_FLASH_MS, 0);
 }
 
-void blink_power_led(uint8_t times)
+// Beacon Energy Model
+//
+// Between flashes the MCU is in standby (~10uA, LSI and AWU only) instead of running HSI, awake only for the flash and
+// a few debounce cycles per period. The flash dominates the average current even at the longest interval, see
+// test_beacon_energy() in test/test_flashlight.c for the figures against MODE_BLINKING.
+void standby_beacon(void)
 {
-    for (uint8_t i = 0; i < times; i++)
+    uint8_t ticks = level_table[current_level].beacon_standby_ticks;
+
+    pause_battery();  // ADC stays powered in standby otherwise
+    if (enter_standby(ticks) == STANDBY_WAKE_TIMER)  // Other wake-ups took an unknown part of it, credit none
     {
-        funDigitalWrite(PIN_POWER_LED, FUN_HIGH);  // Turn on LED
-        Delay_Ms(100);
-        funDigitalWrite(PIN_POWER_LED, FUN_LOW);  // Turn off LED
-        Delay_Ms(100);
+        advance_timer_ticks(ticks * STANDBY_TICK_MS);  // Keep power monitoring on time
     }
+    resume_battery();
+
+    start_beacon_flash();
 }
 
 void power_monitor(void)
@@ -177,31 +176,24 @@ void power_monitor(void)
     static uint8_t power_low_count = 0;
     uint16_t       adc_ref         = 0;  // Internal reference 1.2V
     uint16_t       adc_mon         = 0;
-    uint32_t       adc_volt_mv;
-    uint32_t       power_volt_mv;
 
-    // Average 8 samples for better stability
-    for (uint8_t i = 0; i < 8; i++)
-    {
-        adc_ref += funAnalogRead(ANALOG_8);           // Internal reference 1.2V
-        adc_mon += funAnalogRead(ADC_POWER_MONITOR);  // A6 (PD6)
-    }
-    adc_ref /= 8;
-    adc_mon /= 8;
+    // 12-bit, oversampled from the last BATTERY_SAMPLES background scans, the ratio does not depend on the resolution
+    read_battery(&adc_ref, &adc_mon);
 
-    adc_volt_mv   = (uint32_t)adc_mon * 1200 / adc_ref;
-    power_volt_mv = adc_volt_mv * (POWER_VOLT_DIV_R_UP + POWER_VOLT_DIV_R_DOWN) / POWER_VOLT_DIV_R_DOWN;
+    // Only the log converts to mV (one divide), decisions compare in the ADC domain, Vref and divider calibrated
+    printf("Vref: (%d) | Vadc: (%d) | Vpower: %d mV\n", adc_ref, adc_mon, to_battery_mv(adc_ref, adc_mon));
 
-    printf("Vref: 1.2 V (%d) | Vadc: %ld mV (%d) | Vpower: %ld mV\n", adc_ref, adc_volt_mv, adc_mon, power_volt_mv);
+    set_indicator_battery(is_battery_above(adc_ref, adc_mon, POWER_BARS_4_VOLT_MV)   ? 4
+                          : is_battery_above(adc_ref, adc_mon, POWER_BARS_3_VOLT_MV) ? 3
+                          : is_battery_above(adc_ref, adc_mon, POWER_BARS_2_VOLT_MV) ? 2
+                                                                                     : 1);
 
-    if (power_volt_mv < POWER_LOW_VOLT_THRESHOLD_MV)
+    if (!is_battery_above(adc_ref, adc_mon, POWER_LOW_VOLT_THRESHOLD_MV))
     {
         if (++power_low_count >= POWER_LOW_COUNT_THRESHOLD)
         {
             printf("Battery too low! Powering off...\n");
-            blink_power_led(10);
-            funDigitalWrite(PIN_LATCH, FUN_LOW);  // Input pull-down
-            // For debugging purpose only, code should not reach here if correctly shutdown.
+            start_indicator_shutdown();  // Latch is released when the pattern is done
             power_low_count = 0;
         }
     }
@@ -215,69 +207,281 @@ void update_led(void)
 {
     printf("Change to %s, level %d\n", mode_names[current_mode], current_level);
 
-    disable_systick();
+    stop_timer(&pattern_timer);
+    is_ramping = 0;  // Hold repeats of a click-then-hold keep the level it jumped to
 
     switch (current_mode)
     {
         case MODE_STEADY:
-            TIM1->CH4CVR = (PWM_CLOCKS_FULL_DUTY_CYCLE * (8 - current_level)) >> 3;  // 12.5, 25%, 37.5%, ..., 100%
+            current_brightness = level_table[current_level].steady_lightness;
+            set_duty_at_next_period(level_table[current_level].steady_duty);
+            break;
+        case MODE_MOONLIGHT:
+            set_burst_at_next_period(level_table[current_level].moonlight_on_periods);
+            break;
+        case MODE_CANDLE:  // Flickers around the steady level
+            current_brightness = level_table[current_level].steady_lightness;
+            init_candle((uint16_t)SysTick->CNT);
+            start_timer(&pattern_timer, CANDLE_STEP_MS, CANDLE_STEP_MS);
             break;
         case MODE_BREATHING:
-            pwm_sequence           = PWM_SEQUENCE_DECREASE;     // Starts by decreasing brightness
-            pwm_update_interval_ms = (current_level + 1) << 1;  // 2ms, 4ms, 6ms, ..., 16ms
-            current_pwm_duty_cycle = 100;                       // 100% duty cycle
-            systick_init();
+            pwm_sequence       = PWM_SEQUENCE_DECREASE;  // Starts by decreasing brightness
+            current_brightness = BRIGHTNESS_MAX;         // Full brightness
+            start_timer(&pattern_timer, level_table[current_level].breathing_interval_ms,
+                        level_table[current_level].breathing_interval_ms);
             break;
         case MODE_BLINKING:
-            pwm_sequence           = PWM_SEQUENCE_ON;
-            pwm_update_interval_ms = (current_level + 3) << 5;  // 96ms, 128ms, 160ms, ..., 320ms
-            systick_init();
+            pwm_sequence = 0;  // Starts on
+            start_timer(&pattern_timer, level_table[current_level].blinking_interval_ms,
+                        level_table[current_level].blinking_interval_ms);
             break;
         case MODE_SOS:
-            pwm_sequence           = 0;                           // Reset sequence
-            TIM1->CH4CVR           = PWM_CLOCKS_ZERO_DUTY_CYCLE;  // Pause before SOS
-            pwm_update_interval_ms = MORSE_CODE_DIT_DURATION_MS;
-            systick_init();
+            pwm_sequence = 0;                // Reset sequence
+            set_brightness(BRIGHTNESS_OFF);  // Pause before SOS
+            start_timer(&pattern_timer, MORSE_CODE_DIT_DURATION_MS, MORSE_CODE_DIT_DURATION_MS);
+            break;
+        case MODE_STROBE:
+            set_strobe(level_table[current_level].strobe_period_ticks, PWM_STROBE_US_TO_TICKS(STROBE_PULSE_US));
+            break;
+        case MODE_BEACON:
+            start_beacon_flash();
+            break;
+        case MODE_RHYTHM:
+            start_rhythm_playback();
+            step_pattern();
             break;
         case MODE_OFF:
-            TIM1->CH4CVR = PWM_CLOCKS_ZERO_DUTY_CYCLE;
+            set_brightness(BRIGHTNESS_OFF);
             break;
     }
 }
 
+void power_off(void)
+{
+    // printf("Powering off...\n");
+    current_mode = MODE_OFF;
+    update_led();
+    release_latch();
+}
+
+// Factory calibration: power on from CALIBRATION_SUPPLY_MV with the Level button held, keep holding for
+// CALIBRATION_HOLD_MS. The power LED lights up, release and click Level exactly CALIBRATION_CLICKS times within
+// CALIBRATION_CLICKS_MS. The factors are stored and the light powers off, the power LED stays lit for a second if the
+// calibration was accepted. Releasing the Level button earlier is a normal power on, an armed calibration that is not
+// confirmed just powers off. A held button in a bag never clicks, and calibrate_battery() refuses any other supply.
+void check_calibration(uint8_t power_led_channel)
+{
+    static soft_timer_t calibration_timer;
+    static soft_timer_t sample_timer;
+    uint8_t             pressed = 1;
+    uint8_t             clicks  = 0;
+    uint8_t             changed = 0;  // Consecutive samples at the other level
+
+    funPinMode(PIN_LEVEL_BUTTON, GPIO_CFGLR_IN_PUPD);
+    funDigitalWrite(PIN_LEVEL_BUTTON, FUN_HIGH);
+
+    // The Level button is sampled every debounce cycle, the CPU sleeps in between
+    start_timer(&sample_timer, BUTTON_DEBOUNCE_INTERVAL_MS, BUTTON_DEBOUNCE_INTERVAL_MS);
+    start_timer(&calibration_timer, CALIBRATION_HOLD_MS, 0);
+    while (!is_timer_expired(&calibration_timer))
+    {
+        sleep_until_next_timer();
+        if (is_timer_expired(&sample_timer) && funDigitalRead(PIN_LEVEL_BUTTON) != FUN_LOW)
+        {
+            stop_timer(&sample_timer);  // Or they keep waking up the main loop
+            stop_timer(&calibration_timer);
+            return;
+        }
+    }
+
+    set_pwm_aux_duty(power_led_channel, PWM_AUX_DUTY_FULL);  // Armed
+    start_timer(&calibration_timer, CALIBRATION_CLICKS_MS, 0);
+    while (!is_timer_expired(&calibration_timer))
+    {
+        sleep_until_next_timer();
+        if (!is_timer_expired(&sample_timer))
+        {
+            continue;
+        }
+
+        changed = ((funDigitalRead(PIN_LEVEL_BUTTON) == FUN_LOW) != pressed) ? changed + 1 : 0;
+        if (changed >= CALIBRATION_DEBOUNCE_CYCLES)
+        {
+            changed = 0;
+            pressed = !pressed;
+            clicks += pressed;
+        }
+    }
+    stop_timer(&sample_timer);
+    set_pwm_aux_duty(power_led_channel, 0);
+
+    if (!pressed && clicks == CALIBRATION_CLICKS && calibrate_battery(CALIBRATION_SUPPLY_MV, POWER_CUTOFF_VOLT_MV))
+    {
+        printf("Calibrated.\n");
+        set_pwm_aux_duty(power_led_channel, PWM_AUX_DUTY_FULL);
+        start_timer(&calibration_timer, CALIBRATION_CONFIRM_MS, 0);
+        while (!is_timer_expired(&calibration_timer))
+        {
+            sleep_until_next_timer();
+        }
+    }
+    release_latch();
+    standby_forever();
+}
+
+void start_ramp(void)
+{
+    // Reverse direction on each hold, unless the ramp cannot move that way.
+    is_ramping     = 1;
+    ramp_direction = !ramp_direction;
+    if (current_brightness >= BRIGHTNESS_MAX)
+    {
+        ramp_direction = PWM_SEQUENCE_DECREASE;
+    }
+    else if (current_brightness <= LEVEL_RAMP_MIN)
+    {
+        ramp_direction = PWM_SEQUENCE_INCREASE;
+    }
+
+    printf("Ramp %s from L* %d\n", (ramp_direction == PWM_SEQUENCE_INCREASE) ? "up" : "down", current_brightness);
+}
+
+void ramp_brightness(void)
+{
+    if (ramp_direction == PWM_SEQUENCE_INCREASE)
+    {
+        current_brightness = (current_brightness > BRIGHTNESS_MAX - LEVEL_RAMP_STEP)
+                                 ? BRIGHTNESS_MAX
+                                 : current_brightness + LEVEL_RAMP_STEP;
+    }
+    else
+    {
+        current_brightness = (current_brightness < LEVEL_RAMP_MIN + LEVEL_RAMP_STEP)
+                                 ? LEVEL_RAMP_MIN
+                                 : current_brightness - LEVEL_RAMP_STEP;
+    }
+    set_brightness(current_brightness);
+}
+
 int main(void)
 {
     SystemInit();
-    Delay_Ms(50);
-
     funGpioInitAll();
+    init_timer();
+    init_standby(PIN_MODE_BUTTON);  // Only one of PC2 and PA2 can wake up from standby, the Mode button does
 
-    // Power on latch by input pull-up
-    funPinMode(PIN_LATCH, GPIO_CFGLR_IN_PUPD);
-    funDigitalWrite(PIN_LATCH, FUN_HIGH);
+    // Power on latch
+    init_latch();
 
-    // Init LED pin
-    funPinMode(PIN_POWER_LED, GPIO_Speed_10MHz | GPIO_CNF_OUT_PP);
-    funDigitalWrite(PIN_POWER_LED, FUN_HIGH);
+    // Reject false wakes before anything else is powered up
+    if (is_locked_out())
+    {
+        check_lockout(PIN_LEVEL_BUTTON);
+    }
 
-    // Init ADC for battery voltage monitoring
-    funAnalogInit();
+    Delay_Ms(50);
+
+    // Init power indicator LED
+    init_pwm_aux();
+    uint8_t power_led_channel = add_pwm_aux_channel(PIN_POWER_LED);
+    init_indicator(power_led_channel);
+
+    // Init ADC for battery voltage monitoring (paced by TIM2), show the state of charge right away
     funPinMode(PIN_POWER_MONITOR, GPIO_CFGLR_IN_ANALOG);
+    init_battery(ADC_POWER_MONITOR, BATTERY_SCALE(POWER_VOLT_DIV_R_UP, POWER_VOLT_DIV_R_DOWN),
+                 BATTERY_VDD_MV_TO_VREF_COUNT(POWER_CUTOFF_VOLT_MV));
+    check_calibration(power_led_channel);
+    power_monitor();
 
     // Init TIM1 for PWM
-    tim1_pwm_init();
-    // TIM1->CH4CVR = PWM_CLOCKS_FULL_DUTY_CYCLE;  // Starts with MODE_STEADY - 100% brightness
+    init_pwm();
+    // set_brightness(BRIGHTNESS_MAX);  // Starts with MODE_STEADY - 100% brightness
     update_led();
 
     button_t mode_button;
     init_button(&mode_button, PIN_MODE_BUTTON);
     button_t level_button;
     init_button(&level_button, PIN_LEVEL_BUTTON);
-
-    uint16_t power_monitoring_cycles = 0;
+    set_button_autorepeat(&level_button, LEVEL_BUTTON_HOLD_DELAY_CYCLES, LEVEL_BUTTON_REPEAT_CYCLES);
+    chord_t chord;
+    init_chord(&chord, &mode_button, &level_button);
+
+    // Every task in the loop is driven by soft timers, the CPU sleeps until the nearest deadline. The debounce tick
+    // runs the button, latch and indicator state machines, which count in 5ms cycles.
+    soft_timer_t debounce_timer;
+    soft_timer_t power_monitor_timer;
+    start_timer(&debounce_timer, BUTTON_DEBOUNCE_INTERVAL_MS, BUTTON_DEBOUNCE_INTERVAL_MS);
+    start_timer(&power_monitor_timer, POWER_MONITORING_MS, POWER_MONITORING_MS);
     while (1)
     {
-        switch (get_button_event(&mode_button))
+        sleep_until_next_timer();
+
+        switch (get_battery_event())
+        {
+            case BATTERY_COLLAPSED:  // Cut power before the MCU browns out, once, the latch reports if it failed
+                power_off();
+                break;
+        }
+
+        if (is_timer_expired(&pattern_timer))
+        {
+            step_pattern();
+        }
+
+        // In an SOS, do not check power to avoid interference
+        if (is_timer_expired(&power_monitor_timer) && current_mode != MODE_SOS)
+        {
+            power_monitor();
+        }
+
+        if (!is_timer_expired(&debounce_timer))
+        {
+            continue;
+        }
+
+        // Only wait for double clicks when they do something in the current mode, otherwise a click takes effect at
+        // debounced release (~25ms) instead of after the 250ms double click window.
+        set_button_gestures(&mode_button,
+                            (current_mode > MODE_STEADY) ? BUTTON_GESTURE_MULTI_PRESS : BUTTON_GESTURE_NONE);
+        set_button_gestures(&level_button, (current_mode != MODE_SOS && current_mode != MODE_RHYTHM)
+                                               ? BUTTON_GESTURE_MULTI_PRESS
+                                               : BUTTON_GESTURE_NONE);
+
+        switch (update_latch())
+        {
+            case LATCH_POWER_OFF_FAILED:  // Still running, e.g. powered by WCH-LinkE, start over
+                init_button(&mode_button, PIN_MODE_BUTTON);
+                current_mode  = MODE_STEADY;
+                current_level = 0;
+                update_led();
+                break;
+        }
+
+        switch (update_indicator())
+        {
+            case INDICATOR_DONE:  // Low battery shutdown pattern finished
+                power_off();
+                break;
+        }
+
+        // The Mode button shares the latch pin, it is only sensed while the latch is held.
+        uint8_t mode_event  = is_latch_button_sensing() ? get_button_event(&mode_button) : BUTTON_NONE;
+        uint8_t level_event = get_button_event(&level_button);
+
+        switch (get_chord_event(&chord, &mode_event, &level_event))
+        {
+            case CHORD_HOLD:  // Hold both buttons to lock out and power off, light off now, latch off on release
+                current_mode = MODE_OFF;
+                update_led();
+                break;
+            case CHORD_HOLD_RELEASED:
+                printf("Lockout armed.\n");
+                set_lockout(1);
+                power_off();
+                break;
+        }
+
+        switch (mode_event)
         {
             case BUTTON_HOLD:  // Enter SOS mode directly
                 if (current_mode != MODE_SOS)
@@ -292,18 +496,7 @@ int main(void)
                 current_mode++;
                 if (current_mode == MODE_OFF)
                 {
-                    // printf("Powering off...\n");
-                    funDigitalWrite(PIN_LATCH, FUN_LOW);  // Input pull-down
-
-                    // These following lines are for debugging purpose only, code should not reach here if correctly
-                    // shutdown. However, if the MCU is powered by WCH-LinkE, the code will keep running. And, the
-                    // button processing logic would detect the power off pull down as a button down, then there would
-                    // be endless BUTTON_HOLD events.
-                    Delay_Ms(100);
-                    funDigitalWrite(PIN_LATCH, FUN_HIGH);  // Input pull-up
-                    current_mode  = MODE_STEADY;
-                    current_level = 0;
-                    update_led();
+                    power_off();
                     break;
                 }
 
@@ -322,14 +515,37 @@ int main(void)
                 break;
         }
 
-        switch (get_button_event(&level_button))
+        // While recording a rhythm, the Level button taps it and the light follows the button.
+        if (current_mode == MODE_RHYTHM && is_rhythm_recording())
+        {
+            switch (level_event)
+            {
+                case BUTTON_PRESSED:
+                    set_brightness(BRIGHTNESS_MAX);
+                    break;
+                case BUTTON_RELEASED:
+                case BUTTON_HOLD_RELEASED:
+                    set_brightness(BRIGHTNESS_OFF);
+                    break;
+            }
+
+            switch (record_rhythm(level_event, &level_button))
+            {
+                case RHYTHM_RECORDED:
+                case RHYTHM_CANCELLED:
+                    update_led();  // Play it back
+                    break;
+            }
+            level_event = BUTTON_NONE;
+        }
+
+        switch (level_event)
         {
             case BUTTON_RELEASED:  // Light level +
                 // printf("Set button released.\n");
                 if (current_mode != MODE_SOS)  // Do not interfere with SOS mode
                 {
-                    current_level++;
-                    current_level %= 8;  // 0 - 7
+                    current_level = level_table[current_level].next;
                     update_led();
                 }
                 break;
@@ -339,36 +555,58 @@ int main(void)
                 // printf("Set button double press released.\n");
                 if (current_mode != MODE_SOS)  // Do not interfere with SOS mode
                 {
-                    if (current_level > 0)
-                    {
-                        current_level--;
-                    }
-                    else
-                    {
-                        current_level = 7;
-                    }
+                    current_level = level_table[current_level].previous;
                     update_led();
                 }
                 break;
-            case BUTTON_HOLD:  // Change light level to min or max
+            case BUTTON_HOLD:  // Ramp in steady, record in rhythm, next signal in SOS, otherwise level to min or max
                 // printf("Set button hold.\n");
+                if (current_mode == MODE_STEADY)
+                {
+                    start_ramp();
+                    ramp_brightness();
+                }
+                else if (current_mode == MODE_RHYTHM)
+                {
+                    stop_timer(&pattern_timer);
+                    set_brightness(BRIGHTNESS_OFF);
+                    start_rhythm_recording();
+                }
+                else if (current_mode == MODE_SOS)  // Restart with the next signal, a deliberate hold only
+                {
+                    current_signal = (current_signal + 1) % SIGNAL_COUNT;
+                    update_led();
+                }
+                else
+                {
+                    current_level = level_table[current_level].hold;  // Lower half -> max; upper half -> 0
+                    update_led();
+                }
+                break;
+            case BUTTON_DOUBLE_PRESS_HOLD:  // Change light level to min or max
                 if (current_mode != MODE_SOS)  // Do not interfere with SOS mode
                 {
-                    current_level = (current_level & 0x4) ? 0 : 7;  // 0/1/2/3 -> 7; 4/5/6/7 -> 0
+                    current_level = level_table[current_level].hold;  // Lower half -> max; upper half -> 0
                     update_led();
                 }
                 break;
+            case BUTTON_HOLD_REPEAT:  // Continue ramping, repeats also follow click-then-hold
+                if (current_mode == MODE_STEADY && is_ramping)
+                {
+                    ramp_brightness();
+                }
+                break;
+            case BUTTON_HOLD_RELEASED:
+                is_ramping = 0;
+                break;
         }
 
-        if (current_mode != MODE_SOS)  // In an SOS, do not check power to avoid interference
+        // Beacon sleeps in standby between flashes, once the LED is off and nothing else is going on. A Level button
+        // press is only seen at the next flash, hold it until the beacon flashes.
+        if (current_mode == MODE_BEACON && pwm_sequence == PWM_SEQUENCE_STANDBY && is_latch_button_sensing() &&
+            is_button_idle(&mode_button) && is_button_idle(&level_button) && is_indicator_dark())
         {
-            if (++power_monitoring_cycles >= POWER_MONITORING_CYCLES)
-            {
-                power_monitor();
-                power_monitoring_cycles = 0;
-            }
+            standby_beacon();
         }
-
-        debounce_delay();
     }
 }
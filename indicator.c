@@ -0,0 +1,125 @@
+#include "indicator.h"
+#include "pwm.h"
+
+#define INDICATOR_BATTERY_DUTY         64   // 64/255 = 25%
+#define INDICATOR_BATTERY_ON_CYCLES    10   // 5ms x 10 = 50ms
+#define INDICATOR_BATTERY_OFF_CYCLES   40   // 5ms x 40 = 200ms
+#define INDICATOR_BATTERY_TRAIN_CYCLES 800  // 5ms x 800 = 4s, from the start of one train to the next
+#define INDICATOR_SHUTDOWN_DUTY        PWM_AUX_DUTY_FULL
+#define INDICATOR_SHUTDOWN_ON_CYCLES   20  // 5ms x 20 = 100ms
+#define INDICATOR_SHUTDOWN_OFF_CYCLES  20  // 5ms x 20 = 100ms
+#define INDICATOR_SHUTDOWN_FLASHES     10
+
+enum indicator_states
+{
+    STATE_INDICATOR_IDLE,
+    STATE_INDICATOR_ON,
+    STATE_INDICATOR_OFF,
+    STATE_INDICATOR_PAUSE
+};
+
+static uint8_t  indicator_channel = 0;
+static uint8_t  indicator_state   = STATE_INDICATOR_IDLE;
+static uint8_t  indicator_repeat  = 0;  // Restart the train after the pause
+static uint8_t  indicator_duty    = 0;
+static uint8_t  indicator_on_cycles;
+static uint8_t  indicator_off_cycles;
+static uint8_t  indicator_flashes;       // Flashes per train
+static uint8_t  indicator_flashes_left;  // Flashes left in the current train
+static uint16_t indicator_pause_cycles;
+static uint16_t indicator_cycles;  // Cycles left in the current state
+
+static void start_train(void)
+{
+    indicator_flashes_left = indicator_flashes;
+    indicator_cycles       = indicator_on_cycles;
+    indicator_state        = STATE_INDICATOR_ON;
+    set_pwm_aux_duty(indicator_channel, indicator_duty);
+}
+
+void init_indicator(uint8_t pwm_aux_channel)
+{
+    indicator_channel = pwm_aux_channel;
+    indicator_state   = STATE_INDICATOR_IDLE;
+    set_pwm_aux_duty(indicator_channel, 0);
+}
+
+// Show the state of charge, 1 - INDICATOR_BARS_MAX. Takes effect with the next train, unless the indicator is idle.
+void set_indicator_battery(uint8_t bars)
+{
+    if (indicator_state != STATE_INDICATOR_IDLE && !indicator_repeat)  // Do not interrupt the shutdown pattern
+    {
+        return;
+    }
+
+    indicator_repeat       = 1;
+    indicator_duty         = INDICATOR_BATTERY_DUTY;
+    indicator_on_cycles    = INDICATOR_BATTERY_ON_CYCLES;
+    indicator_off_cycles   = INDICATOR_BATTERY_OFF_CYCLES;
+    indicator_flashes      = bars;
+    indicator_pause_cycles = INDICATOR_BATTERY_TRAIN_CYCLES -
+                             (INDICATOR_BATTERY_ON_CYCLES + INDICATOR_BATTERY_OFF_CYCLES) * bars;
+    if (indicator_state == STATE_INDICATOR_IDLE)
+    {
+        start_train();
+    }
+}
+
+void start_indicator_shutdown(void)
+{
+    indicator_repeat     = 0;
+    indicator_duty       = INDICATOR_SHUTDOWN_DUTY;
+    indicator_on_cycles  = INDICATOR_SHUTDOWN_ON_CYCLES;
+    indicator_off_cycles = INDICATOR_SHUTDOWN_OFF_CYCLES;
+    indicator_flashes    = INDICATOR_SHUTDOWN_FLASHES;
+    start_train();
+}
+
+// Call every debounce cycle (5ms).
+uint8_t update_indicator(void)
+{
+    uint8_t indicator_event = INDICATOR_NONE;
+
+    if (indicator_state == STATE_INDICATOR_IDLE || --indicator_cycles > 0)
+    {
+        return INDICATOR_NONE;
+    }
+
+    switch (indicator_state)
+    {
+        case STATE_INDICATOR_ON:
+            set_pwm_aux_duty(indicator_channel, 0);
+            indicator_cycles = indicator_off_cycles;
+            indicator_state  = STATE_INDICATOR_OFF;
+            break;
+        case STATE_INDICATOR_OFF:
+            if (--indicator_flashes_left > 0)
+            {
+                set_pwm_aux_duty(indicator_channel, indicator_duty);
+                indicator_cycles = indicator_on_cycles;
+                indicator_state  = STATE_INDICATOR_ON;
+            }
+            else if (indicator_repeat)
+            {
+                indicator_cycles = indicator_pause_cycles;
+                indicator_state  = STATE_INDICATOR_PAUSE;
+            }
+            else
+            {
+                indicator_state = STATE_INDICATOR_IDLE;
+                indicator_event = INDICATOR_DONE;
+            }
+            break;
+        case STATE_INDICATOR_PAUSE:
+            start_train();
+            break;
+    }
+
+    return indicator_event;
+}
+
+// Off for at least a full auxiliary PWM period, the LED stays off if the timers stop (e.g. in standby).
+uint8_t is_indicator_dark(void)
+{
+    return indicator_state == STATE_INDICATOR_IDLE || indicator_state == STATE_INDICATOR_PAUSE;
+}
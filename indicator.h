@@ -0,0 +1,32 @@
+#ifndef __INDICATOR_H__
+#define __INDICATOR_H__
+
+#include "ch32fun.h"
+
+// Power Indicator LED Patterns
+//
+// The indicator is off most of the time and shows short flash trains on an auxiliary PWM channel, driven from the
+// debounce cycle (5ms) without blocking.
+//
+//   Battery  | N flashes of 50ms every 4s, N = state of charge in bars (1-4), at 25% duty
+//            | |‾|____|‾|____|‾|____|‾|_________________________________________|‾|____ ...
+//   Shutdown | 10 flashes of 100ms at full duty, then INDICATOR_DONE
+//
+// Average current of the power LED (~1.35mA fully on): 4 bars = 4 x 50ms / 4s x 25% x 1.35mA = ~0.017mA, 1 bar
+// ~0.004mA.
+
+#define INDICATOR_BARS_MAX 4
+
+enum indicator_events
+{
+    INDICATOR_NONE,
+    INDICATOR_DONE  // Shutdown pattern finished
+};
+
+void    init_indicator(uint8_t pwm_aux_channel);
+void    set_indicator_battery(uint8_t bars);
+void    start_indicator_shutdown(void);
+uint8_t update_indicator(void);
+uint8_t is_indicator_dark(void);
+
+#endif  // __INDICATOR_H__
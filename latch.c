@@ -0,0 +1,66 @@
+#include "latch.h"
+#include <stdio.h>
+
+#define LATCH_RELEASE_CYCLES 20  // 5ms x 20 = 100ms, power should be gone well before this
+#define LATCH_SETTLE_CYCLES  5   // 5ms x 5 = 25ms of pin high before sensing the Mode button again
+
+#define printf(...) (void)0  // Disable printf to save flash
+
+static uint8_t latch_state  = LATCH_HELD;
+static uint8_t latch_cycles = 0;
+
+void init_latch(void)
+{
+    // Power on latch by input pull-up
+    funPinMode(PIN_LATCH, GPIO_CFGLR_IN_PUPD);
+    funDigitalWrite(PIN_LATCH, FUN_HIGH);
+    latch_state = LATCH_HELD;
+}
+
+void release_latch(void)
+{
+    funDigitalWrite(PIN_LATCH, FUN_LOW);  // Input pull-down
+    latch_cycles = 0;
+    latch_state  = LATCH_RELEASING;
+    printf("LATCH_RELEASING\n");
+}
+
+// Call every debounce cycle (5ms).
+uint8_t update_latch(void)
+{
+    uint8_t latch_event = LATCH_NONE;
+
+    switch (latch_state)
+    {
+        case LATCH_HELD:
+            break;
+        case LATCH_RELEASING:
+            if (++latch_cycles >= LATCH_RELEASE_CYCLES)  // Still running, not powered by the latch
+            {
+                funDigitalWrite(PIN_LATCH, FUN_HIGH);  // Input pull-up
+                latch_cycles = 0;
+                latch_state  = LATCH_SETTLING;
+                printf("LATCH_SETTLING\n");
+            }
+            break;
+        case LATCH_SETTLING:
+            if (funDigitalRead(PIN_LATCH) == FUN_LOW)
+            {
+                latch_cycles = 0;
+            }
+            else if (++latch_cycles >= LATCH_SETTLE_CYCLES)
+            {
+                latch_state = LATCH_HELD;
+                latch_event = LATCH_POWER_OFF_FAILED;
+                printf("Emit LATCH_POWER_OFF_FAILED\n");
+            }
+            break;
+    }
+
+    return latch_event;
+}
+
+uint8_t is_latch_button_sensing(void)
+{
+    return latch_state == LATCH_HELD;
+}
@@ -0,0 +1,49 @@
+#ifndef __LATCH_H__
+#define __LATCH_H__
+
+#include "ch32fun.h"
+
+// Soft Latching Power Driver
+//
+// PC2 is both the latch and the Mode button. The input pull-up keeps the latch on, and pressing the Mode button pulls
+// the pin low. The input pull-down turns the latch off, power is gone once the Mode button is also released.
+//
+// Latch States
+//  +-------------------------------+  release_latch()  +-------------------------------+
+//  |  LATCH_HELD                   | ----------------> |  LATCH_RELEASING              |
+//  |  - Pull-up, latch on          |                   |  - Pull-down, latch off       |
+//  |  - Pin senses Mode button     |                   |  - Mode button masked         |
+//  +-------------------------------+                   +-------------------------------+
+//                  ^                                                   | Still running after LATCH_RELEASE_CYCLES,
+//                  | Pin high for LATCH_SETTLE_CYCLES                  V e.g. powered by WCH-LinkE
+//                  |                                   +-------------------------------+
+//                  +---------------------------------- |  LATCH_SETTLING               |
+//                     Emit LATCH_POWER_OFF_FAILED      |  - Pull-up, latch on          |
+//                                                      |  - Mode button masked         |
+//                                                      +-------------------------------+
+//
+// Running after the release timeout is the proof that power-down did not happen. The pull-down leaves the pin low for
+// a while after the pull-up is restored, so the Mode button stays masked until the pin reads high again, instead of the
+// button logic seeing an endless press.
+
+#define PIN_LATCH PC2  // Latch pin, also the Mode button pin
+
+enum latch_states
+{
+    LATCH_HELD,
+    LATCH_RELEASING,
+    LATCH_SETTLING
+};
+
+enum latch_events
+{
+    LATCH_NONE,
+    LATCH_POWER_OFF_FAILED
+};
+
+void    init_latch(void);
+void    release_latch(void);
+uint8_t update_latch(void);
+uint8_t is_latch_button_sensing(void);
+
+#endif  // __LATCH_H__
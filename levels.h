@@ -0,0 +1,103 @@
+#ifndef __LEVELS_H__
+#define __LEVELS_H__
+
+#include "brightness.h"
+#include "pwm.h"
+#include "standby.h"
+
+// Level Configuration
+//
+// LEVEL_COUNT sets the number of levels offered by the Level button, all per-level values and level transitions are
+// generated at compile time into level_table[], update_led() and the button handlers only index the table.
+//
+//   Level | Steady (CIE L*)    | Moonlight duty | Breathing step | Blinking interval | Strobe | Beacon interval
+//   0     | 100%               | 0.1%           | 2ms            | 96ms              | 20Hz   | 1s
+//   ...   | equal L* steps     | linear         | linear         | linear            | linear | linear, 80ms steps
+//   max   | 100% / LEVEL_COUNT | 0.0083%        | 16ms           | 320ms             | 5Hz    | 5s
+//
+// Moonlight burst gates the 60kHz carrier at 1% duty, on for 12 down to 1 of every 120 periods, see pwm.h. All
+// moonlight levels flicker at the frame rate, 500Hz, well above what the eye can see.
+//
+//   Level (8)  | 0      | 1       | 2       | 3       | 4       | 5       | 6       | 7
+//   On periods | 12     | 11      | 9       | 8       | 6       | 5       | 3       | 1
+//   Duty       | 0.100% | 0.092%  | 0.075%  | 0.067%  | 0.050%  | 0.042%  | 0.025%  | 0.008%
+//
+// Level 0 is the default after a mode change. Click wraps max -> 0, double click wraps 0 -> max, hold jumps to max
+// from the lower half of the levels and to 0 from the upper half.
+//
+// In steady mode, hold ramps brightness instead, LEVEL_RAMP_STEP of CIE L* per BUTTON_HOLD_REPEAT (~66 per second),
+// between LEVEL_RAMP_MIN and BRIGHTNESS_MAX. The ramp direction reverses on each hold. A click or double click goes
+// back to the table levels, click then hold jumps to min or max in any mode.
+
+#define LEVEL_COUNT 8  // 4, 8 or 16
+
+#define LEVEL_MAX  (LEVEL_COUNT - 1)
+#define LEVEL_HALF (LEVEL_COUNT >> 1)
+
+#define LEVEL_BREATHING_INTERVAL_MIN_MS 2
+#define LEVEL_BREATHING_INTERVAL_MAX_MS 16
+#define LEVEL_BLINKING_INTERVAL_MIN_MS  96
+#define LEVEL_BLINKING_INTERVAL_MAX_MS  320
+#define LEVEL_MOONLIGHT_ON_MAX_PERIODS  12  // 12 / 120 x 1% = 0.1%
+#define LEVEL_MOONLIGHT_ON_MIN_PERIODS  1   // 1 / 120 x 1% = 0.0083%
+#define LEVEL_STROBE_FREQUENCY_MAX_HZ   20
+#define LEVEL_STROBE_FREQUENCY_MIN_HZ   5
+#define LEVEL_BEACON_INTERVAL_MIN_MS    1000
+#define LEVEL_BEACON_INTERVAL_MAX_MS    5000  // Up to STANDBY_TICKS_MAX x STANDBY_TICK_MS = 5.04s
+#define LEVEL_RAMP_STEP                 1  // CIE L* per BUTTON_HOLD_REPEAT, 100 steps x 15ms = 1.5s full sweep
+#define LEVEL_RAMP_MIN                  1  // CIE L*, dimmest ramp brightness, the light never ramps off
+
+typedef struct level
+{
+    uint16_t steady_duty;            // PWM duty
+    uint8_t  steady_lightness;       // CIE L*, start of a steady mode ramp
+    uint8_t  moonlight_on_periods;   // Burst length of every PWM_BURST_FRAME_PERIODS
+    uint8_t  breathing_interval_ms;  // Interval between CIE L* steps
+    uint16_t blinking_interval_ms;   // On / off time
+    uint16_t strobe_period_ticks;    // Strobe period in PWM_STROBE_TICK_US
+    uint8_t  beacon_standby_ticks;   // Standby time between flashes
+    uint8_t  next;                   // Level after click
+    uint8_t  previous;               // Level after double click
+    uint8_t  hold;                   // Level after hold
+} level_t;
+
+#define LEVEL_INTERPOLATE(min, max, l) ((min) + ((max) - (min)) * (l) / LEVEL_MAX)
+
+#define LEVEL_ENTRY(l)                                                                         \
+    {                                                                                          \
+        .steady_duty           = CIE_LIGHTNESS_TO_DUTY_SCALED(LEVEL_COUNT - (l), LEVEL_COUNT), \
+        .steady_lightness      = BRIGHTNESS_MAX * (LEVEL_COUNT - (l)) / LEVEL_COUNT,           \
+        .moonlight_on_periods  = LEVEL_INTERPOLATE(LEVEL_MOONLIGHT_ON_MAX_PERIODS,             \
+                                                   LEVEL_MOONLIGHT_ON_MIN_PERIODS, l),         \
+        .breathing_interval_ms = LEVEL_INTERPOLATE(LEVEL_BREATHING_INTERVAL_MIN_MS,            \
+                                                   LEVEL_BREATHING_INTERVAL_MAX_MS, l),        \
+        .blinking_interval_ms  = LEVEL_INTERPOLATE(LEVEL_BLINKING_INTERVAL_MIN_MS,             \
+                                                   LEVEL_BLINKING_INTERVAL_MAX_MS, l),         \
+        .strobe_period_ticks   = PWM_STROBE_HZ_TO_TICKS(LEVEL_INTERPOLATE(                     \
+            LEVEL_STROBE_FREQUENCY_MAX_HZ, LEVEL_STROBE_FREQUENCY_MIN_HZ, l)),                 \
+        .beacon_standby_ticks  = STANDBY_MS_TO_TICKS(LEVEL_INTERPOLATE(                        \
+            LEVEL_BEACON_INTERVAL_MIN_MS, LEVEL_BEACON_INTERVAL_MAX_MS, l)),                   \
+        .next                  = ((l) == LEVEL_MAX) ? 0 : (l) + 1,                             \
+        .previous              = ((l) == 0) ? LEVEL_MAX : (l) - 1,                             \
+        .hold                  = ((l) < LEVEL_HALF) ? LEVEL_MAX : 0,                           \
+    }
+
+#define LEVEL_TABLE_4 LEVEL_ENTRY(0), LEVEL_ENTRY(1), LEVEL_ENTRY(2), LEVEL_ENTRY(3)
+#define LEVEL_TABLE_8 LEVEL_TABLE_4, LEVEL_ENTRY(4), LEVEL_ENTRY(5), LEVEL_ENTRY(6), LEVEL_ENTRY(7)
+#define LEVEL_TABLE_16                                                                                            \
+    LEVEL_TABLE_8, LEVEL_ENTRY(8), LEVEL_ENTRY(9), LEVEL_ENTRY(10), LEVEL_ENTRY(11), LEVEL_ENTRY(12), LEVEL_ENTRY(13), \
+        LEVEL_ENTRY(14), LEVEL_ENTRY(15)
+
+#if LEVEL_COUNT == 4
+#define LEVEL_TABLE LEVEL_TABLE_4
+#elif LEVEL_COUNT == 8
+#define LEVEL_TABLE LEVEL_TABLE_8
+#elif LEVEL_COUNT == 16
+#define LEVEL_TABLE LEVEL_TABLE_16
+#else
+#error "LEVEL_COUNT must be 4, 8 or 16"
+#endif
+
+extern const level_t level_table[LEVEL_COUNT];
+
+#endif  // __LEVELS_H__
@@ -0,0 +1,56 @@
+#include "lockout.h"
+#include <stdio.h>
+#include "latch.h"
+#include "standby.h"
+#include "storage.h"
+#include "timer.h"
+
+#define SETTINGS_MAGIC        0x464C5348  // "FLSH", settings page has been written
+#define SETTINGS_WORD_MAGIC   0
+#define SETTINGS_WORD_LOCKOUT 1
+#define LOCKOUT_ARMED         0x4C4F434B  // "LOCK"
+
+uint8_t is_locked_out(void)
+{
+    const volatile storage_page_t *settings = read_storage(STORAGE_PAGE_SETTINGS);
+    return settings->words[SETTINGS_WORD_MAGIC] == SETTINGS_MAGIC &&
+           settings->words[SETTINGS_WORD_LOCKOUT] == LOCKOUT_ARMED;
+}
+
+void set_lockout(uint8_t armed)
+{
+    const volatile storage_page_t *stored = read_storage(STORAGE_PAGE_SETTINGS);
+    storage_page_t                 settings;
+    for (uint8_t i = 0; i < STORAGE_PAGE_WORDS; i++)
+    {
+        settings.words[i] = stored->words[i];
+    }
+    settings.words[SETTINGS_WORD_MAGIC]   = SETTINGS_MAGIC;
+    settings.words[SETTINGS_WORD_LOCKOUT] = armed ? LOCKOUT_ARMED : STORAGE_ERASED;
+    write_storage(STORAGE_PAGE_SETTINGS, &settings);
+}
+
+// While locked out, the Level button must already be held when the Mode button is pressed to power on. Anything else
+// is a false wake (e.g. a bump in a bag), the latch is dropped on the first sample of a released Level button, right
+// after wake-up, and the MCU waits in standby (no ADC, no LED, no clocks) until the Mode button lets go and power is
+// gone. A matching gesture disarms the lockout.
+void check_lockout(uint8_t level_pin)
+{
+    static soft_timer_t check_timer;
+
+    funPinMode(level_pin, GPIO_CFGLR_IN_PUPD);
+    funDigitalWrite(level_pin, FUN_HIGH);
+
+    start_timer(&check_timer, LOCKOUT_CHECK_MS, 0);
+    while (!is_timer_expired(&check_timer))
+    {
+        if (funDigitalRead(level_pin) != FUN_LOW)
+        {
+            release_latch();
+            standby_forever();
+        }
+    }
+
+    printf("Lockout disarmed.\n");
+    set_lockout(0);
+}
@@ -0,0 +1,23 @@
+#ifndef __LOCKOUT_H__
+#define __LOCKOUT_H__
+
+#include "ch32fun.h"
+
+// Electronic Lockout
+//
+// The Mode button is also the power latch, so any bump in a bag powers the MCU up. While lockout is armed (stored in
+// the settings page), check_lockout() runs right after the latch is held and before anything else is powered up:
+//
+//   Level held, then Mode pressed | Level still down LOCKOUT_CHECK_MS after wake-up, lockout disarmed, normal power on
+//   Anything else                 | Latch dropped on the first released Level sample, standby until power is gone
+//
+// A false wake costs the boot plus a few microseconds of sampling at run current, then standby current for as long as
+// the bump keeps the Mode button down. test/test_lockout.c simulates bag-bump press patterns and reports the energy.
+
+#define LOCKOUT_CHECK_MS 10  // Level button must be down for 10ms after wake-up to unlock
+
+uint8_t is_locked_out(void);
+void    set_lockout(uint8_t armed);
+void    check_lockout(uint8_t level_pin);
+
+#endif  // __LOCKOUT_H__
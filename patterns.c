@@ -0,0 +1,12 @@
+#include "patterns.h"
+
+static const uint32_t sos_bits[]   = {0xABBBAA00};              // 1010 1011 1011 1011 1010 1010 0000 0000
+static const uint32_t help_bits[]  = {0xAA22EA2E, 0xE8000000};  // 1010 1010 0010 0010 1110 1010 0010 1110 | 1110 1
+static const uint32_t blink_bits[] = {0x80000000};              // 10
+
+const pattern_t signal_patterns[SIGNAL_COUNT] = {
+    [SIGNAL_SOS]  = {sos_bits, 32},
+    [SIGNAL_HELP] = {help_bits, 44},
+};
+
+const pattern_t blink_pattern = {blink_bits, 2};
@@ -0,0 +1,42 @@
+#ifndef __PATTERNS_H__
+#define __PATTERNS_H__
+
+#include "ch32fun.h"
+
+// Packed On/Off Patterns
+//
+// A pattern is a bit string, one bit per step of the pattern timer, 1 - on, 0 - off, packed MSB first into 32-bit
+// words. Stepping is one word lookup and a shift, and a new signal costs its words plus the pattern_t.
+//
+// Morse code, from Wikipedia:
+// > The duration of a dah is three times the duration of a dit. Each dit or dah within an encoded character is
+// > followed by a period of signal absence, called a space, equal to the dit duration.
+// Letters are separated by 3 dits of silence, words by 7. SOS is a prosign, sent as one character without letter gaps.
+//
+//   SOS   | . . . --- --- --- . . .             | 10101011101110111010101 + 9 off   | 32 steps, 4.8s at 150ms
+//   HELP  | .... . .-.. .--.                    | 1010101 000 1 000 101110101 000   | 44 steps, 6.6s at 150ms
+//         |                                     | 10111011101 + 7 off               |
+//   Blink | on, off                             | 10                                | 2 steps
+
+typedef struct pattern
+{
+    const uint32_t *bits;    // MSB first
+    uint8_t         length;  // In steps (bits)
+} pattern_t;
+
+enum signals
+{
+    SIGNAL_SOS,
+    SIGNAL_HELP,
+    SIGNAL_COUNT
+};
+
+extern const pattern_t signal_patterns[SIGNAL_COUNT];
+extern const pattern_t blink_pattern;
+
+static inline uint8_t is_pattern_on(const pattern_t *pattern, uint8_t step)
+{
+    return (pattern->bits[step >> 5] << (step & 0x1F)) >> 31;
+}
+
+#endif  // __PATTERNS_H__
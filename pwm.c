@@ -0,0 +1,298 @@
+#include "pwm.h"
+
+#define PWM_AUX_PRESCALER  (FUNCONF_SYSTEM_CORE_CLOCK / PWM_AUX_FREQUENCY / PWM_AUX_DUTY_FULL)
+#define PWM_AUX_BAM        0  // No TIM2 channel, driven by BAM
+#define PWM_AUX_BAM_SLOTS  6  // Bits 7, 6, 5, 4, 3 and off
+
+typedef struct pwm_aux_channel
+{
+    uint8_t pin;
+    uint8_t timer_channel;  // TIM2 channel 1-3, or PWM_AUX_BAM
+    uint8_t duty;
+} pwm_aux_channel_t;
+
+static pwm_aux_channel_t aux_channels[PWM_AUX_CHANNELS_MAX];
+static uint8_t           aux_channel_count = 0;
+static uint8_t           bam_slot          = 0;
+static uint8_t           burst_on_periods  = 0;  // 0 - burst gating off
+static uint8_t           burst_queued_on   = 0;  // Phase loaded at the next update event
+static uint8_t           strobe_active     = 0;  // TIM1 prescaled to strobe ticks
+
+void init_pwm(void)
+{
+    // Enable GPIOC and TIM1
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_TIM1;
+
+    // PC4 is T1CH4, 10MHz Output alt func, push-pull
+    GPIOC->CFGLR &= ~(0xf << (4 * 4));
+    GPIOC->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * 4);
+
+    // Reset TIM1 to init all regs
+    RCC->APB2PRSTR |= RCC_APB2Periph_TIM1;
+    RCC->APB2PRSTR &= ~RCC_APB2Periph_TIM1;
+
+    // Prescaler
+    TIM1->PSC = 0x0000;
+
+    // Auto Reload - sets period, preloaded so period changes take effect at the next update event
+    TIM1->ATRLR = PWM_CLOCKS_FULL_DUTY_CYCLE - 1;
+    TIM1->CTLR1 |= TIM_ARPE;
+
+    // CH4 Mode is output, PWM1 (CC4S = 00, OC4M = 110), compare value preloaded
+    TIM1->CHCTLR2 |= TIM_OC4M_2 | TIM_OC4M_1 | TIM_OC4PE;
+
+    // Set the Capture Compare Register value to 0% initially
+    TIM1->CH4CVR = PWM_CLOCKS_ZERO_DUTY_CYCLE;
+
+    // Reload immediately, load the shadow registers
+    TIM1->SWEVGR |= TIM_UG;
+
+    // Enable CH4 output, positive pol
+    TIM1->CCER |= TIM_CC4E | TIM_CC4NP;
+
+    // Enable TIM1 outputs
+    TIM1->BDTR |= TIM_MOE;
+
+    // Enable TIM1
+    TIM1->CTLR1 |= TIM_CEN;
+}
+
+// Set period and compare value in timer clocks, both take effect at the next update event.
+//
+// UDIS blocks the update event while the pair is written. If the counter overflows in between, it still restarts from
+// 0 with the old shadow registers, and the new pair is latched at the following update event instead of half of it.
+void set_period_at_next_period(uint16_t period_clocks, uint16_t compare_clocks)
+{
+    if (burst_on_periods)  // Back to one update event per period
+    {
+        TIM1->DMAINTENR &= ~TIM_UIE;
+        burst_on_periods = 0;
+    }
+
+    TIM1->CTLR1 |= TIM_UDIS;
+    TIM1->PSC    = 0;
+    TIM1->RPTCR  = 0;
+    TIM1->ATRLR  = period_clocks - 1;
+    TIM1->CH4CVR = compare_clocks;
+    TIM1->CTLR1 &= ~TIM_UDIS;
+
+    if (strobe_active)  // Do not wait for the end of a strobe period, up to 200ms
+    {
+        TIM1->SWEVGR |= TIM_UG;
+        strobe_active = 0;
+    }
+}
+
+// Set LED duty cycle, 0 - PWM_DUTY_FULL, takes effect at the next update event.
+//
+// With PWM_ADAPTIVE_FREQUENCY, the PWM period is doubled (frequency halved) every time the duty cycle halves below
+// 50%, down to PWM_FREQUENCY >> PWM_ADAPTIVE_MAX_SHIFT. This keeps at least ~50 compare counts for the on-time
+// instead of a fixed 100 counts per period, so low brightness gets finer steps.
+//
+//   Duty (of 1023)  | Frequency | Period (clocks) | Compare step
+//   512 - 1023      | 60kHz     | 100             | 1.00%
+//   256 - 511       | 30kHz     | 200             | 0.50%
+//   128 - 255       | 15kHz     | 400             | 0.25%
+//    64 - 127       | 7.5kHz    | 800             | 0.125%
+//     0 - 63        | 3.75kHz   | 1600            | 0.0625%
+//
+// E.g. the steady levels (CIE L* 100%, 87.5%, ..., 12.5%) are duty 1023, 727, 494, 317, 188, 100, 45 and 15, the
+// dimmest level is 23/1600 at 3.75kHz instead of 1/100 at 60kHz.
+void set_duty_at_next_period(uint16_t duty)
+{
+#if PWM_ADAPTIVE_FREQUENCY
+    uint8_t shift = 0;
+    while (shift < PWM_ADAPTIVE_MAX_SHIFT && (duty << shift) < ((PWM_DUTY_FULL + 1) >> 1))
+    {
+        shift++;
+    }
+#else
+    const uint8_t shift = 0;
+#endif
+
+    set_period_at_next_period(PWM_CLOCKS_FULL_DUTY_CYCLE << shift,
+                              ((PWM_CLOCKS_FULL_DUTY_CYCLE * (uint32_t)duty << shift) + (PWM_DUTY_FULL >> 1)) >> 10);
+}
+
+// Gate the 60kHz carrier at the minimum compare value, on_periods of every PWM_BURST_FRAME_PERIODS. The average duty
+// is on_periods / PWM_BURST_FRAME_PERIODS / 100, e.g. 12 -> 0.1%, 1 -> 0.0083%. set_duty_at_next_period() and
+// set_period_at_next_period() end burst gating.
+void set_burst_at_next_period(uint8_t on_periods)
+{
+    if (strobe_active)  // Back to the 60kHz carrier first
+    {
+        set_period_at_next_period(PWM_CLOCKS_FULL_DUTY_CYCLE, PWM_CLOCKS_ZERO_DUTY_CYCLE);
+    }
+
+    TIM1->DMAINTENR &= ~TIM_UIE;
+
+    // Queue the on phase, the update interrupt alternates the phases from then on. The flag is cleared while UDIS
+    // holds off update events, so a pending flag afterwards always comes from the update that loaded the on phase.
+    TIM1->CTLR1 |= TIM_UDIS;
+    TIM1->INTFR  = ~TIM_UIF;
+    TIM1->ATRLR  = PWM_CLOCKS_FULL_DUTY_CYCLE - 1;
+    TIM1->CH4CVR = PWM_BURST_COMPARE_CLOCKS;
+    TIM1->RPTCR  = on_periods - 1;
+    TIM1->CTLR1 &= ~TIM_UDIS;
+
+    burst_on_periods = on_periods;
+    burst_queued_on  = 1;
+
+    TIM1->DMAINTENR |= TIM_UIE;
+    NVIC_EnableIRQ(TIM1_UP_IRQn);
+}
+
+// Strobe pulses in hardware, one pulse of pulse_ticks at the start of every period_ticks, in PWM_STROBE_TICK_US steps.
+// Starts right away with a pulse, no interrupts. set_duty_at_next_period() and set_period_at_next_period() end it.
+void set_strobe(uint16_t period_ticks, uint16_t pulse_ticks)
+{
+    TIM1->DMAINTENR &= ~TIM_UIE;
+    burst_on_periods = 0;
+
+    TIM1->CTLR1 |= TIM_UDIS;
+    TIM1->PSC    = PWM_STROBE_PRESCALER - 1;
+    TIM1->RPTCR  = 0;
+    TIM1->ATRLR  = period_ticks - 1;
+    TIM1->CH4CVR = pulse_ticks;
+    TIM1->CTLR1 &= ~TIM_UDIS;
+    TIM1->SWEVGR |= TIM_UG;  // Load now and restart the counter, the first pulse starts immediately
+
+    strobe_active = 1;
+}
+
+// The phase queued before has just been loaded, queue the other one for the following update event.
+void TIM1_UP_IRQHandler(void) __attribute__((interrupt));
+void TIM1_UP_IRQHandler(void)
+{
+    TIM1->INTFR = ~TIM_UIF;
+
+    burst_queued_on = !burst_queued_on;
+    if (burst_queued_on)
+    {
+        TIM1->CH4CVR = PWM_BURST_COMPARE_CLOCKS;
+        TIM1->RPTCR  = burst_on_periods - 1;
+    }
+    else
+    {
+        TIM1->CH4CVR = PWM_CLOCKS_ZERO_DUTY_CYCLE;
+        TIM1->RPTCR  = PWM_BURST_FRAME_PERIODS - burst_on_periods - 1;
+    }
+}
+
+void init_pwm_aux(void)
+{
+    // Enable AFIO and TIM2, TIM2 partial remap 2 (CH1/PC1, CH2/PD3, CH3/PC0, CH4/PD7)
+    RCC->APB2PCENR |= RCC_APB2Periph_AFIO;
+    RCC->APB1PCENR |= RCC_APB1Periph_TIM2;
+    AFIO->PCFR1 = (AFIO->PCFR1 & ~AFIO_PCFR1_TIM2_REMAP) | AFIO_PCFR1_TIM2_REMAP_PARTIALREMAP2;
+
+    // Reset TIM2 to init all regs
+    RCC->APB1PRSTR |= RCC_APB1Periph_TIM2;
+    RCC->APB1PRSTR &= ~RCC_APB1Periph_TIM2;
+
+    // One frame is PWM_AUX_DUTY_FULL ticks, compare value PWM_AUX_DUTY_FULL is always on
+    TIM2->PSC   = PWM_AUX_PRESCALER - 1;
+    TIM2->ATRLR = PWM_AUX_DUTY_FULL - 1;
+    TIM2->CTLR1 |= TIM_ARPE;
+    TIM2->SWEVGR |= TIM_UG;
+
+    aux_channel_count = 0;
+    TIM2->CTLR1 |= TIM_CEN;
+}
+
+// Returns the channel index for set_pwm_aux_duty(), the channel starts off. Returns PWM_AUX_CHANNEL_INVALID once
+// PWM_AUX_CHANNELS_MAX channels exist, set_pwm_aux_duty() ignores it.
+uint8_t add_pwm_aux_channel(uint8_t pin)
+{
+    static const uint8_t tim2_pins[] = {PC1, PD3, PC0};  // CH1, CH2, CH3
+
+    if (aux_channel_count >= PWM_AUX_CHANNELS_MAX)
+    {
+        return PWM_AUX_CHANNEL_INVALID;
+    }
+
+    pwm_aux_channel_t *channel = &aux_channels[aux_channel_count];
+    channel->pin               = pin;
+    channel->timer_channel     = PWM_AUX_BAM;
+    channel->duty              = 0;
+    for (uint8_t i = 0; i < sizeof(tim2_pins); i++)
+    {
+        if (tim2_pins[i] == pin)
+        {
+            channel->timer_channel = i + 1;
+        }
+    }
+
+    switch (channel->timer_channel)
+    {
+        case 1:  // PWM1 mode, compare preload
+            TIM2->CHCTLR1 |= TIM_OC1M_2 | TIM_OC1M_1 | TIM_OC1PE;
+            break;
+        case 2:
+            TIM2->CHCTLR1 |= (TIM_OC1M_2 | TIM_OC1M_1 | TIM_OC1PE) << 8;
+            break;
+        case 3:
+            TIM2->CHCTLR2 |= TIM_OC1M_2 | TIM_OC1M_1 | TIM_OC1PE;
+            break;
+        case PWM_AUX_BAM:  // Start BAM scheduling with the first BAM channel
+            funPinMode(pin, GPIO_Speed_10MHz | GPIO_CNF_OUT_PP);
+            funDigitalWrite(pin, FUN_LOW);
+            if (!(TIM2->DMAINTENR & TIM_CC4IE))
+            {
+                bam_slot       = 0;
+                TIM2->CH4CVR   = 0;
+                TIM2->INTFR    = ~TIM_CC4IF;
+                TIM2->DMAINTENR |= TIM_CC4IE;
+                NVIC_EnableIRQ(TIM2_IRQn);
+            }
+            break;
+    }
+
+    if (channel->timer_channel != PWM_AUX_BAM)
+    {
+        (&TIM2->CH1CVR)[channel->timer_channel - 1] = 0;
+        TIM2->CCER |= TIM_CC1E << (4 * (channel->timer_channel - 1));
+        funPinMode(pin, GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF);
+    }
+
+    return aux_channel_count++;
+}
+
+// Set duty cycle 0 - PWM_AUX_DUTY_FULL, hardware channels take effect at the next frame, BAM channels at the next slot.
+void set_pwm_aux_duty(uint8_t channel, uint8_t duty)
+{
+    if (channel >= aux_channel_count)
+    {
+        return;
+    }
+
+    aux_channels[channel].duty = duty;
+    if (aux_channels[channel].timer_channel != PWM_AUX_BAM)
+    {
+        (&TIM2->CH1CVR)[aux_channels[channel].timer_channel - 1] = duty;
+    }
+}
+
+// BAM slot i starts at tick 256 - (256 >> i) and shows bit 7 - i of the duty, the last slot is off.
+void TIM2_IRQHandler(void) __attribute__((interrupt));
+void TIM2_IRQHandler(void)
+{
+    TIM2->INTFR = ~TIM_CC4IF;
+
+    for (uint8_t i = 0; i < aux_channel_count; i++)
+    {
+        if (aux_channels[i].timer_channel == PWM_AUX_BAM)
+        {
+            funDigitalWrite(aux_channels[i].pin,
+                            (bam_slot < PWM_AUX_BAM_SLOTS - 1 && (aux_channels[i].duty & (0x80 >> bam_slot)))
+                                ? FUN_HIGH
+                                : FUN_LOW);
+        }
+    }
+
+    if (++bam_slot >= PWM_AUX_BAM_SLOTS)
+    {
+        bam_slot = 0;
+    }
+    TIM2->CH4CVR = 256 - (256 >> bam_slot);  // Slot 0 starts at 0 in the next frame
+}
@@ -0,0 +1,82 @@
+#ifndef __PWM_H__
+#define __PWM_H__
+
+#include "ch32fun.h"
+
+// TIM1 CH4 (PC4) PWM driver for the SGM3732 EN/PWM input.
+//
+// Both the period (ARPE) and the compare value (OC4PE) are preloaded. Updates are written to the shadow registers with
+// update events disabled (UDIS), so a period/compare pair is always latched together at the next update event. A write
+// can never truncate or double the pulse of the running period, regardless of when it happens.
+//
+//  Counter  |0 ....... CVR ....... ATRLR|0 ....... CVR' ...... ATRLR'|
+//  Output   |‾‾‾‾‾‾‾‾‾‾|________________|‾‾‾‾‾‾‾‾‾‾‾‾|_______________|
+//                 ^ write CVR', ATRLR'  ^ update event, shadow registers loaded
+
+#define PWM_FREQUENCY              ((uint32_t)60 * 1000)                        // 60kHz
+#define PWM_CLOCKS_FULL_DUTY_CYCLE (FUNCONF_SYSTEM_CORE_CLOCK / PWM_FREQUENCY)  // 100% duty cycle
+#define PWM_CLOCKS_ZERO_DUTY_CYCLE 0                                            // 0% duty cycle
+#define PWM_DUTY_FULL              1023                                         // 100% duty in set_duty_* units
+#define PWM_ADAPTIVE_FREQUENCY     1                                            // Lower frequency for lower duty
+#define PWM_ADAPTIVE_MAX_SHIFT     4                                            // 60kHz >> 4 = 3.75kHz (>= 2kHz)
+
+// Burst gating for output below one compare count (moonlight).
+//
+// The 60kHz carrier runs at the minimum compare value for a burst of on periods, then at 0 for the rest of a fixed
+// frame. The TIM1 repetition counter stretches each phase to a single update event, the update interrupt only queues
+// the next phase into the preloaded registers, so the burst timing is exact in hardware. The SGM3732 filters the CTRL
+// duty into its feedback reference, the frame rate is the flicker frequency.
+//
+//   Carrier  |‾|_________|‾|_________|_________|_________|_ ... _|‾|_________|
+//            |<-- on periods x 1% -->|<-- off periods x 0% ----->|
+//            |<-------------- frame, 120 periods = 2ms --------->|
+//
+// The off gap stays below the SGM3732 minimum shutdown pulse width (tOFF = 3ms), so the driver never shuts down and
+// soft-starts again. The repetition counter is 8-bit, each phase is at most 256 periods.
+
+#define PWM_BURST_COMPARE_CLOCKS 1    // 1/100 at 60kHz, the minimum compare value
+#define PWM_BURST_FRAME_PERIODS  120  // 120 / 60kHz = 2ms, 500Hz flicker, off gap < 2ms < tOFF
+
+// Strobe, TIM1 prescaled to PWM_STROBE_TICK_US per tick, the pulse is the compare value of a 5-20Hz period.
+//
+//   Output   |‾‾‾‾|_____________________________________|‾‾‾‾|______ ...
+//            |<-->| pulse_ticks x 4us
+//            |<------------- period_ticks x 4us ------->|
+//
+// The timer produces every pulse, no interrupts, exact to the HCLK (HSI, +-1% over temperature). 16-bit ticks of 4us
+// cover periods up to 262ms (3.8Hz). The CTRL pin stays low longer than the SGM3732 tOFF (3ms) between pulses, so the
+// driver shuts down and soft-starts on every pulse, keep pulses well above the soft-start time.
+
+#define PWM_STROBE_TICK_US          4
+#define PWM_STROBE_PRESCALER        (FUNCONF_SYSTEM_CORE_CLOCK / 1000000 * PWM_STROBE_TICK_US)  // 24 at 6MHz
+#define PWM_STROBE_US_TO_TICKS(us)  ((us) / PWM_STROBE_TICK_US)
+#define PWM_STROBE_HZ_TO_TICKS(hz)  (1000000 / PWM_STROBE_TICK_US / (hz))
+
+// Auxiliary PWM channels for indicator LEDs (e.g. the power LED on PC1), on the TIM2 time base.
+//
+// Pins with a TIM2 output (partial remap 2) are driven by hardware, any other GPIO falls back to bit angle modulation
+// (BAM) from the TIM2 CH4 compare interrupt. Both share one 255-tick frame at PWM_AUX_FREQUENCY.
+//
+//   TIM2 pins  | PC1 - CH1, PD3 - CH2, PC0 - CH3 (CH4 compare is reserved for BAM scheduling)
+//   Hardware   | 8-bit duty, no interrupts
+//   BAM        | Bits 7..3 of the duty (steps of 8/255), 6 interrupts per frame only while a BAM channel exists
+//
+//   BAM frame  |0          128     192  224 240 248 255|
+//              |  bit 7    | bit 6 |bit5|b4 |b3 |off|
+
+#define PWM_AUX_FREQUENCY       200  // Hz, frame rate of hardware and BAM channels
+#define PWM_AUX_DUTY_FULL       255  // 100% duty
+#define PWM_AUX_CHANNELS_MAX    4
+#define PWM_AUX_CHANNEL_INVALID 0xFF  // add_pwm_aux_channel() with all channels taken
+
+void init_pwm(void);
+void set_duty_at_next_period(uint16_t duty);
+void set_period_at_next_period(uint16_t period_clocks, uint16_t compare_clocks);
+void set_burst_at_next_period(uint8_t on_periods);
+void set_strobe(uint16_t period_ticks, uint16_t pulse_ticks);
+
+void    init_pwm_aux(void);
+uint8_t add_pwm_aux_channel(uint8_t pin);
+void    set_pwm_aux_duty(uint8_t channel, uint8_t duty);
+
+#endif  // __PWM_H__
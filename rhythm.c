@@ -0,0 +1,143 @@
+#include "rhythm.h"
+#include "storage.h"
+#include "timer.h"
+
+#define RHYTHM_CYCLES_PER_UNIT_SHIFT 2  // 4 debounce cycles (5ms) per 20ms unit
+#define RHYTHM_PRESS_DEBOUNCE_CYCLES 5  // Press debounce, counted in post_release_cycles but not in hold_cycles
+#define RHYTHM_PAGE_COUNT            0  // Byte offsets in the page
+#define RHYTHM_PAGE_RUNS             1
+
+#define printf(...) (void)0  // Disable printf to save flash
+
+static const uint8_t default_runs[] = {5, 5, 5, 35};  // Double flash, 100ms on / off, 700ms pause
+
+static storage_page_t          recording;  // Runs being recorded, written to flash as a whole
+static uint8_t                 is_recording = 0;
+static uint8_t                 is_tap_down  = 0;  // A recorded press, not the hold that started the recording
+static soft_timer_t            record_timer;
+static const volatile uint8_t *playback_runs;
+static uint8_t                 playback_count;
+static uint8_t                 playback_index;
+
+// Debounce cycles to units, rounded, at least 1 and at most 255.
+static uint8_t cycles_to_units(uint32_t cycles)
+{
+    cycles = (cycles + (1 << (RHYTHM_CYCLES_PER_UNIT_SHIFT - 1))) >> RHYTHM_CYCLES_PER_UNIT_SHIFT;
+    return (cycles == 0) ? 1 : (cycles > UINT8_MAX) ? UINT8_MAX : cycles;
+}
+
+static void append_run(uint8_t units)
+{
+    recording.bytes[RHYTHM_PAGE_RUNS + recording.bytes[RHYTHM_PAGE_COUNT]++] = units;
+}
+
+static uint8_t finish_recording(void)
+{
+    is_recording = 0;
+    stop_timer(&record_timer);
+
+    if (recording.bytes[RHYTHM_PAGE_COUNT] == 0)
+    {
+        printf("Rhythm cancelled\n");
+        return RHYTHM_CANCELLED;
+    }
+
+    append_run(RHYTHM_RECORD_TIMEOUT_MS / RHYTHM_UNIT_MS);  // The final off run, pause before repeating
+    write_storage(STORAGE_PAGE_RHYTHM, &recording);
+    printf("Rhythm recorded, %d runs\n", recording.bytes[RHYTHM_PAGE_COUNT]);
+    return RHYTHM_RECORDED;
+}
+
+// The Level button may still be down, e.g. from the hold that started the recording, taps start at the next press.
+void start_rhythm_recording(void)
+{
+    for (uint8_t i = 0; i < STORAGE_PAGE_WORDS; i++)
+    {
+        recording.words[i] = STORAGE_ERASED;
+    }
+    recording.bytes[RHYTHM_PAGE_COUNT] = 0;
+    is_recording                       = 1;
+    is_tap_down                        = 0;
+    start_timer(&record_timer, RHYTHM_RECORD_TIMEOUT_MS, 0);
+    printf("Rhythm recording\n");
+}
+
+uint8_t is_rhythm_recording(void)
+{
+    return is_recording;
+}
+
+// Call every debounce cycle while recording, with the event of the button, which must not subscribe to
+// BUTTON_GESTURE_MULTI_PRESS so every press and release is reported right away.
+uint8_t record_rhythm(uint8_t button_event, button_t *button)
+{
+    uint8_t count = recording.bytes[RHYTHM_PAGE_COUNT];
+
+    switch (button_event)
+    {
+        case BUTTON_PRESSED:
+            if (count > 0)  // Off run since the previous release
+            {
+                append_run(cycles_to_units(button->post_release_cycles));
+            }
+            is_tap_down = 1;
+            break;
+        case BUTTON_RELEASED:
+        case BUTTON_HOLD_RELEASED:
+            if (is_tap_down)
+            {
+                is_tap_down = 0;
+                append_run(cycles_to_units(button->hold_cycles + RHYTHM_PRESS_DEBOUNCE_CYCLES));
+                if (count + 1 >= RHYTHM_RUNS_MAX - 1)  // Room for the final off run only
+                {
+                    return finish_recording();
+                }
+            }
+            start_timer(&record_timer, RHYTHM_RECORD_TIMEOUT_MS, 0);
+            break;
+    }
+
+    // Silence only counts while the button is up
+    if (!is_button_pressed(button) && is_timer_expired(&record_timer))
+    {
+        return finish_recording();
+    }
+
+    return RHYTHM_NONE;
+}
+
+// Also abandons a recording that was left unfinished, e.g. by a mode change.
+void start_rhythm_playback(void)
+{
+    is_recording = 0;
+    stop_timer(&record_timer);
+
+    const volatile storage_page_t *stored = read_storage(STORAGE_PAGE_RHYTHM);
+    uint8_t                        count  = stored->bytes[RHYTHM_PAGE_COUNT];
+
+    // Erased (0xFF) or corrupt pages play the default, a valid rhythm has on / off pairs
+    if (count >= 2 && count <= RHYTHM_RUNS_MAX && !(count & 1))
+    {
+        playback_runs  = &stored->bytes[RHYTHM_PAGE_RUNS];
+        playback_count = count;
+    }
+    else
+    {
+        playback_runs  = default_runs;
+        playback_count = sizeof(default_runs);
+    }
+    playback_index = 0;
+}
+
+// Duration of the next run in ms, is_on tells whether the light is on during it.
+uint16_t next_rhythm_run(uint8_t *is_on)
+{
+    uint8_t units = playback_runs[playback_index];
+
+    *is_on = !(playback_index & 1);
+    if (++playback_index >= playback_count)
+    {
+        playback_index = 0;
+    }
+    return units * RHYTHM_UNIT_MS;
+}
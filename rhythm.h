@@ -0,0 +1,37 @@
+#ifndef __RHYTHM_H__
+#define __RHYTHM_H__
+
+#include "ch32fun.h"
+#include "button.h"
+
+// Tap-to-Record Rhythm
+//
+// The Level button taps a rhythm, the on (pressed) and off (released) durations are quantized to RHYTHM_UNIT_MS and
+// stored run-length encoded in a flash page, then played back in a loop by the pattern timer.
+//
+//   Taps      |‾‾‾|__|‾|______|‾‾‾‾‾‾|___...2s...|
+//   Runs      | 8   5  3  14     20     100       | 20ms units, alternating on / off, starting with on
+//   Page      | count | run 0 | run 1 | ... | run 61 |
+//
+// Durations come from the button state machine (hold_cycles, post_release_cycles), which counts debounce cycles
+// anyway, recording adds no per-tick work. Recording ends RHYTHM_RECORD_TIMEOUT_MS after the last release, that wait
+// becomes the pause before the rhythm repeats. Without a recording, a double flash is played.
+
+#define RHYTHM_UNIT_MS            20
+#define RHYTHM_RUNS_MAX           62    // 31 taps, one byte per run after the count
+#define RHYTHM_RECORD_TIMEOUT_MS  2000  // Silence that ends a recording
+
+enum rhythm_events
+{
+    RHYTHM_NONE,
+    RHYTHM_RECORDED,  // Stored in flash
+    RHYTHM_CANCELLED  // No taps, the stored rhythm is kept
+};
+
+void     start_rhythm_recording(void);
+uint8_t  is_rhythm_recording(void);
+uint8_t  record_rhythm(uint8_t button_event, button_t *button);
+void     start_rhythm_playback(void);
+uint16_t next_rhythm_run(uint8_t *is_on);
+
+#endif  // __RHYTHM_H__
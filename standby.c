@@ -0,0 +1,69 @@
+#include "standby.h"
+
+static uint32_t standby_wake_line;  // EXTI line mask of the wake pin
+
+void init_standby(uint8_t wake_pin)
+{
+    uint8_t line = wake_pin & 0xf;
+    uint8_t port = wake_pin >> 4;  // PA = 0, PC = 2, PD = 3, same encoding as AFIO->EXTICR
+
+    standby_wake_line = 1 << line;
+
+    RCC->APB1PCENR |= RCC_APB1Periph_PWR;
+    RCC->APB2PCENR |= RCC_APB2Periph_AFIO;
+
+    // LSI clocks the AWU counter
+    RCC->RSTSCKR |= RCC_LSION;
+    while (!(RCC->RSTSCKR & RCC_LSIRDY))
+    {
+    }
+
+    // Wake-up events, AWU on EXTI line 9, wake pin falling edge on its own line. The interrupt mask latches the
+    // flags that tell the wake source apart, the PFIC never enables these interrupts, no handler runs.
+    AFIO->EXTICR = (AFIO->EXTICR & ~(0x3 << (line * 2))) | (port << (line * 2));
+    EXTI->EVENR |= EXTI_Line9 | standby_wake_line;
+    EXTI->FTENR |= EXTI_Line9 | standby_wake_line;
+    EXTI->INTENR |= EXTI_Line9 | standby_wake_line;
+
+    PWR->AWUPSC = PWR_AWUPSC_10240;
+}
+
+// Standby for 1 - STANDBY_TICKS_MAX AWU ticks, or until the wake pin goes low. The wake source is taken from the
+// EXTI flags latched by the edges, not from the pin level after the fact, a press that bounced or was released
+// before it could be read is still STANDBY_WAKE_PIN. If the AWU window also ended, it is STANDBY_WAKE_TIMER.
+uint8_t enter_standby(uint8_t ticks)
+{
+    EXTI->INTFR = EXTI_Line9 | standby_wake_line;  // Write 1 to clear
+
+    PWR->AWUWR = (ticks > STANDBY_TICKS_MAX) ? STANDBY_TICKS_MAX : (ticks == 0) ? 1 : ticks;
+    PWR->AWUCSR |= PWR_AWUCSR_AWUEN;
+    PWR->CTLR |= PWR_CTLR_PDDS;
+    PFIC->SCTLR |= (1 << 2);  // SLEEPDEEP
+
+    __WFE();
+
+    // Back on HSI with the same prescaler, SysTick resumes where it stopped. Clear SLEEPDEEP, or every WFI would
+    // enter standby from now on.
+    PFIC->SCTLR &= ~(1 << 2);
+    PWR->CTLR &= ~PWR_CTLR_PDDS;
+    PWR->AWUCSR &= ~PWR_AWUCSR_AWUEN;
+
+    uint32_t flags = EXTI->INTFR & (EXTI_Line9 | standby_wake_line);
+    EXTI->INTFR    = flags;
+
+    return (flags & EXTI_Line9)          ? STANDBY_WAKE_TIMER
+           : (flags & standby_wake_line) ? STANDBY_WAKE_PIN
+                                         : STANDBY_WAKE_OTHER;
+}
+
+// Standby until power is gone, the only way out is a power cycle or reset.
+void standby_forever(void)
+{
+    RCC->APB1PCENR |= RCC_APB1Periph_PWR;
+    PWR->CTLR |= PWR_CTLR_PDDS;
+    PFIC->SCTLR |= (1 << 2);  // SLEEPDEEP
+    while (1)
+    {
+        __WFI();
+    }
+}
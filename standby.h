@@ -0,0 +1,36 @@
+#ifndef __STANDBY_H__
+#define __STANDBY_H__
+
+#include "ch32fun.h"
+
+// Standby with Auto-Wakeup
+//
+// Standby stops HCLK, HSI and all timers, only LSI (128kHz) keeps running the auto-wakeup (AWU) counter. SRAM,
+// registers and GPIO states are kept and execution continues after the WFE, so the soft latch stays held by its
+// pull-up. PWM outputs freeze at their current level, drive them low before entering standby.
+//
+//   AWU tick   | LSI 128kHz / 10240 = 80ms
+//   AWU window | 6 bits, 1-63 ticks = 80ms - 5.04s
+//
+// A falling edge on the wake pin also wakes up (EXTI event). EXTI lines are shared by pin number across ports, so PC2
+// and PA2 cannot both wake up, only one wake pin is supported. LSI is only accurate to a few percent.
+//
+// The AWU counter cannot be read, only a timer wake-up is a known duration, the whole window. After a pin wake-up, or
+// an early return of the WFE on an event latched before, the time spent is somewhere below the window.
+
+#define STANDBY_TICK_MS         80
+#define STANDBY_TICKS_MAX       63
+#define STANDBY_MS_TO_TICKS(ms) (((ms) + STANDBY_TICK_MS / 2) / STANDBY_TICK_MS)  // Compile time only
+
+enum standby_wake_sources
+{
+    STANDBY_WAKE_TIMER,  // The AWU window ended
+    STANDBY_WAKE_PIN,    // Falling edge on the wake pin
+    STANDBY_WAKE_OTHER   // Neither, e.g. an event latched before the WFE
+};
+
+void    init_standby(uint8_t wake_pin);
+uint8_t enter_standby(uint8_t ticks);
+void    standby_forever(void);
+
+#endif  // __STANDBY_H__
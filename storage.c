@@ -0,0 +1,58 @@
+#include "storage.h"
+
+static const volatile storage_page_t storage_pages[STORAGE_PAGE_IMAGE_COUNT]
+    __attribute__((aligned(STORAGE_PAGE_SIZE))) = {[0 ... STORAGE_PAGE_IMAGE_COUNT - 1] = {
+                                                       .words = {[0 ... STORAGE_PAGE_WORDS - 1] = STORAGE_ERASED}}};
+
+static void wait_for_flash(void)
+{
+    while (FLASH->STATR & SR_BSY);
+}
+
+const volatile storage_page_t *read_storage(uint8_t page)
+{
+    if (page < STORAGE_PAGE_IMAGE_COUNT)
+    {
+        return &storage_pages[page];
+    }
+    return (const volatile storage_page_t *)(STORAGE_FIXED_ADDRESS +
+                                             (page - STORAGE_PAGE_IMAGE_COUNT) * STORAGE_PAGE_SIZE);
+}
+
+// Erase and program a page, takes a few milliseconds. The core stalls on flash access meanwhile, interrupts are
+// delayed.
+void write_storage(uint8_t page, const storage_page_t *data)
+{
+    // Flash is aliased at 0x00000000, the flash controller takes the 0x08000000 address.
+    uint32_t           address = FLASH_BASE + ((uint32_t)read_storage(page) & 0x00FFFFFF);
+    volatile uint32_t *buffer  = (volatile uint32_t *)address;
+
+    // Unlock flash and fast program / erase mode
+    FLASH->KEYR     = FLASH_KEY1;
+    FLASH->KEYR     = FLASH_KEY2;
+    FLASH->MODEKEYR = FLASH_KEY1;
+    FLASH->MODEKEYR = FLASH_KEY2;
+
+    // Fast page erase
+    FLASH->CTLR = CR_PAGE_ER;
+    FLASH->ADDR = address;
+    FLASH->CTLR = CR_PAGE_ER | CR_STRT_Set;
+    wait_for_flash();
+
+    // Fast page program, load the 64-byte buffer word by word then program it at once
+    FLASH->CTLR = CR_PAGE_PG;
+    FLASH->CTLR = CR_PAGE_PG | CR_BUF_RST;
+    wait_for_flash();
+    for (uint8_t i = 0; i < STORAGE_PAGE_WORDS; i++)
+    {
+        buffer[i]   = data->words[i];
+        FLASH->CTLR = CR_PAGE_PG | CR_BUF_LOAD;
+        wait_for_flash();
+    }
+    FLASH->ADDR = address;
+    FLASH->CTLR = CR_PAGE_PG | CR_STRT_Set;
+    wait_for_flash();
+
+    // Lock flash
+    FLASH->CTLR = CR_LOCK_Set;
+}
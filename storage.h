@@ -0,0 +1,41 @@
+#ifndef __STORAGE_H__
+#define __STORAGE_H__
+
+#include "ch32fun.h"
+
+// Persistent storage in 64-byte flash pages.
+//
+// Settings pages are part of the firmware image (.rodata, page aligned), so the linker accounts for them and flashing
+// new firmware resets them to erased (0xFF). Per-unit pages that must survive a reflash sit at the top of the flash,
+// outside the image. minichlink only erases the pages it writes, and storage.ld fails the link if the image ever grows
+// into them. Each page is erased and programmed as a whole with the CH32V003 fast page erase / page program, pages
+// are read directly from flash through a volatile pointer.
+//
+//   Flash  |0x0000 image, settings pages ... |free ... |0x3FC0 calibration|0x4000
+
+#define STORAGE_PAGE_SIZE  64
+#define STORAGE_PAGE_WORDS (STORAGE_PAGE_SIZE / 4)
+#define STORAGE_ERASED     0xFFFFFFFF
+#define STORAGE_FLASH_SIZE (16 * 1024)  // CH32V003, keep storage.ld in sync
+
+enum storage_pages
+{
+    STORAGE_PAGE_SETTINGS,
+    STORAGE_PAGE_RHYTHM,
+    STORAGE_PAGE_IMAGE_COUNT,                             // Pages above are in the image, erased by a reflash
+    STORAGE_PAGE_CALIBRATION = STORAGE_PAGE_IMAGE_COUNT,  // Pages below are at the top of the flash, kept
+    STORAGE_PAGE_COUNT
+};
+
+#define STORAGE_FIXED_ADDRESS (STORAGE_FLASH_SIZE - (STORAGE_PAGE_COUNT - STORAGE_PAGE_IMAGE_COUNT) * STORAGE_PAGE_SIZE)
+
+typedef union storage_page
+{
+    uint32_t words[STORAGE_PAGE_WORDS];
+    uint8_t  bytes[STORAGE_PAGE_SIZE];
+} storage_page_t;
+
+const volatile storage_page_t *read_storage(uint8_t page);
+void                           write_storage(uint8_t page, const storage_page_t *data);
+
+#endif  // __STORAGE_H__
@@ -0,0 +1,450 @@
+#include "ch32fun_host.h"
+
+// Handlers of the modules linked into a test, missing ones are never dispatched.
+void SysTick_Handler(void) __attribute__((weak));
+void TIM1_UP_IRQHandler(void) __attribute__((weak));
+void ADC1_IRQHandler(void) __attribute__((weak));
+
+uint64_t fake_hclk     = 0;
+uint32_t fake_failures = 0;
+
+SysTick_Type        fake_systick = {.CTLR = SYSTICK_CTLR_STE | SYSTICK_CTLR_STCLK};  // Started by SystemInit()
+TIM_TypeDef         fake_tim1;
+TIM_TypeDef         fake_tim2;
+GPIO_TypeDef        fake_gpio[4];
+RCC_TypeDef         fake_rcc;
+AFIO_TypeDef        fake_afio;
+EXTI_TypeDef        fake_exti;
+PWR_TypeDef         fake_pwr;
+PFIC_Type           fake_pfic;
+ADC_TypeDef         fake_adc1;
+DMA_TypeDef         fake_dma1;
+DMA_Channel_TypeDef fake_dma1_channel1;
+FLASH_TypeDef       fake_flash;
+
+int (*fake_pin_input)(uint8_t pin)                                   = NULL;
+void (*fake_tim1_period)(uint32_t period_clocks, uint32_t high_clocks) = NULL;
+void (*fake_wfi)(void)                                                 = NULL;
+void (*fake_wfe)(void)                                                 = NULL;
+uint16_t (*fake_adc_input)(uint8_t channel)                            = NULL;
+
+static uint32_t access_clocks_min = 1;
+static uint32_t access_clocks_max = 1;
+static uint32_t random_state      = 0x2545F491;
+static uint64_t irq_enabled_mask  = 0;
+static uint8_t  irq_enabled       = 1;  // Enabled by the startup code
+static uint8_t  in_handler        = 0;
+static uint32_t wake_events       = 0;  // Interrupt flags set so far, wakes __WFI()
+
+// EXTI flags, INTFR only shows them, writes clear the bits written as 1
+static uint32_t exti_pending = 0;
+
+// ADC and DMA state that is not visible in the registers
+static uint32_t adc_scan_clocks = 0;
+static uint16_t dma_count       = 0;  // CNTR as written, reloaded in circular mode
+
+// TIM1 state that is not visible in the registers
+static uint16_t tim1_prescaler_count = 0;
+static uint16_t tim1_shadow_psc      = 0;
+static uint16_t tim1_shadow_atrlr    = 0;
+static uint16_t tim1_shadow_ch4cvr   = 0;
+static uint16_t tim1_repetition      = 0;
+static uint32_t tim1_period_clocks   = 0;
+static uint32_t tim1_high_clocks     = 0;
+
+static uint8_t is_irq_enabled(IRQn_Type irq)
+{
+    return (irq_enabled_mask >> irq) & 1;
+}
+
+static void dispatch_interrupts(void)
+{
+    if (!irq_enabled || in_handler)
+    {
+        return;
+    }
+
+    in_handler = 1;
+    if ((fake_systick.SR & 1) && (fake_systick.CTLR & SYSTICK_CTLR_STIE) && is_irq_enabled(SysTicK_IRQn) &&
+        SysTick_Handler)
+    {
+        SysTick_Handler();
+    }
+    if ((fake_tim1.INTFR & TIM_UIF) && (fake_tim1.DMAINTENR & TIM_UIE) && is_irq_enabled(TIM1_UP_IRQn) &&
+        TIM1_UP_IRQHandler)
+    {
+        TIM1_UP_IRQHandler();
+    }
+    if ((fake_adc1.STATR & ADC_AWD) && (fake_adc1.CTLR1 & ADC_AWDIE) && is_irq_enabled(ADC_IRQn) && ADC1_IRQHandler)
+    {
+        ADC1_IRQHandler();
+    }
+    in_handler = 0;
+}
+
+static void tim1_update_event(void)
+{
+    tim1_shadow_psc    = fake_tim1.PSC;
+    tim1_shadow_atrlr  = fake_tim1.ATRLR;
+    tim1_shadow_ch4cvr = fake_tim1.CH4CVR;
+    tim1_repetition    = fake_tim1.RPTCR;
+    fake_tim1.INTFR |= TIM_UIF;
+    wake_events += (fake_tim1.DMAINTENR & TIM_UIE) != 0;
+}
+
+static void tim1_end_period(void)
+{
+    if (tim1_period_clocks && fake_tim1_period)
+    {
+        fake_tim1_period(tim1_period_clocks, tim1_high_clocks);
+    }
+    tim1_period_clocks = 0;
+    tim1_high_clocks   = 0;
+}
+
+// UG reloads the shadow registers and restarts counter and prescaler, even with UDIS set.
+static void tim1_software_events(void)
+{
+    if (fake_tim1.SWEVGR & TIM_UG)
+    {
+        fake_tim1.SWEVGR &= ~TIM_UG;
+        tim1_update_event();
+        fake_tim1.CNT        = 0;
+        tim1_prescaler_count = 0;
+        tim1_end_period();
+    }
+}
+
+static void tim1_clock(void)
+{
+    tim1_software_events();
+    if (!(fake_tim1.CTLR1 & TIM_CEN))
+    {
+        return;
+    }
+
+    uint16_t atrlr  = (fake_tim1.CTLR1 & TIM_ARPE) ? tim1_shadow_atrlr : fake_tim1.ATRLR;
+    uint16_t ch4cvr = (fake_tim1.CHCTLR2 & TIM_OC4PE) ? tim1_shadow_ch4cvr : fake_tim1.CH4CVR;
+
+    // PWM1, active while CNT < CH4CVR
+    tim1_period_clocks++;
+    if ((fake_tim1.CCER & TIM_CC4E) && (fake_tim1.BDTR & TIM_MOE) && fake_tim1.CNT < ch4cvr)
+    {
+        tim1_high_clocks++;
+    }
+
+    if (tim1_prescaler_count < tim1_shadow_psc)
+    {
+        tim1_prescaler_count++;
+        return;
+    }
+    tim1_prescaler_count = 0;
+
+    if (fake_tim1.CNT < atrlr)
+    {
+        fake_tim1.CNT++;
+        return;
+    }
+
+    fake_tim1.CNT = 0;
+    tim1_end_period();
+    if (!(fake_tim1.CTLR1 & TIM_UDIS))
+    {
+        if (tim1_repetition == 0)
+        {
+            tim1_update_event();
+        }
+        else
+        {
+            tim1_repetition--;
+        }
+    }
+}
+
+// One triggered regular scan. Non-PIE test binaries keep static buffers below 4GB, MADDR holds the whole address.
+static void adc_scan(void)
+{
+    uint8_t conversions = ((fake_adc1.RSQR1 & ADC_L) >> 20) + 1;
+
+    if (!(fake_adc1.CTLR2 & ADC_ADON) || !(fake_adc1.CTLR2 & ADC_EXTTRIG) || !fake_adc_input)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < conversions; i++)
+    {
+        uint8_t  channel = (fake_adc1.RSQR3 >> (5 * i)) & 0x1f;
+        uint16_t result  = fake_adc_input(channel) & 0x3ff;
+
+        fake_adc1.RDATAR = result;
+        if ((fake_adc1.CTLR1 & ADC_AWDEN) &&
+            (!(fake_adc1.CTLR1 & ADC_AWDSGL) || channel == (fake_adc1.CTLR1 & ADC_AWDCH)) &&
+            (result > fake_adc1.WDHTR || result < fake_adc1.WDLTR))
+        {
+            fake_adc1.STATR |= ADC_AWD;
+            wake_events += (fake_adc1.CTLR1 & ADC_AWDIE) != 0;
+        }
+
+        if ((fake_adc1.CTLR2 & ADC_DMA) && (fake_dma1_channel1.CFGR & DMA_CFGR1_EN) && fake_dma1_channel1.CNTR)
+        {
+            if (dma_count < fake_dma1_channel1.CNTR)
+            {
+                dma_count = fake_dma1_channel1.CNTR;
+            }
+            volatile uint16_t *memory = (volatile uint16_t *)(uintptr_t)fake_dma1_channel1.MADDR;
+            memory[dma_count - fake_dma1_channel1.CNTR] = result;
+            if (--fake_dma1_channel1.CNTR == 0 && (fake_dma1_channel1.CFGR & DMA_CFGR1_CIRC))
+            {
+                fake_dma1_channel1.CNTR = dma_count;
+            }
+        }
+    }
+}
+
+static void adc_clocks(uint64_t clocks)
+{
+    while (clocks >= FAKE_ADC_SCAN_CLOCKS - adc_scan_clocks)
+    {
+        clocks -= FAKE_ADC_SCAN_CLOCKS - adc_scan_clocks;
+        adc_scan_clocks = 0;
+        adc_scan();
+    }
+    adc_scan_clocks += clocks;
+}
+
+static void clock(void)
+{
+    fake_hclk++;
+
+    if (fake_systick.CTLR & SYSTICK_CTLR_STE)
+    {
+        if (++fake_systick.CNT == fake_systick.CMP)
+        {
+            fake_systick.SR = 1;
+            wake_events++;
+        }
+    }
+
+    tim1_clock();
+    adc_clocks(1);
+    dispatch_interrupts();
+}
+
+void fake_advance(uint64_t clocks)
+{
+    // Nothing but SysTick counts, skip ahead
+    if (!(fake_tim1.CTLR1 & TIM_CEN) && !(fake_tim1.SWEVGR & TIM_UG))
+    {
+        uint32_t to_match = fake_systick.CMP - fake_systick.CNT;
+        uint8_t  match    = (fake_systick.CTLR & SYSTICK_CTLR_STE) &&
+                        (clocks >= ((to_match == 0) ? ((uint64_t)1 << 32) : to_match));
+
+        fake_hclk += clocks;
+        if (fake_systick.CTLR & SYSTICK_CTLR_STE)
+        {
+            fake_systick.CNT += (uint32_t)clocks;
+        }
+        if (match)
+        {
+            fake_systick.SR = 1;
+            wake_events++;
+        }
+        adc_clocks(clocks);
+        dispatch_interrupts();
+        return;
+    }
+
+    while (clocks--)
+    {
+        clock();
+    }
+}
+
+void fake_set_access_clocks(uint32_t min, uint32_t max)
+{
+    access_clocks_min = min;
+    access_clocks_max = max;
+}
+
+static void access(void)
+{
+    fake_advance(access_clocks_min + fake_random() % (access_clocks_max - access_clocks_min + 1));
+}
+
+uint32_t fake_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+uint8_t fake_expect(int condition, const char *text, const char *file, int line)
+{
+    if (!condition)
+    {
+        printf("%s:%d: failed: %s\n", file, line, text);
+        fake_failures++;
+    }
+    return condition != 0;
+}
+
+SysTick_Type *fake_systick_access(void)
+{
+    access();
+    return &fake_systick;
+}
+
+TIM_TypeDef *fake_tim1_access(void)
+{
+    tim1_software_events();
+    access();
+    return &fake_tim1;
+}
+
+RCC_TypeDef *fake_rcc_access(void)
+{
+    access();
+    if (fake_rcc.RSTSCKR & RCC_LSION)
+    {
+        fake_rcc.RSTSCKR |= RCC_LSIRDY;
+    }
+    return &fake_rcc;
+}
+
+ADC_TypeDef *fake_adc1_access(void)
+{
+    access();
+    fake_adc1.CTLR2 &= ~(CTLR2_RSTCAL_Set | CTLR2_CAL_Set);
+    return &fake_adc1;
+}
+
+DMA_Channel_TypeDef *fake_dma1_channel1_access(void)
+{
+    access();
+    return &fake_dma1_channel1;
+}
+
+// INTFR is write 1 to clear. Every access leaves the flags with FAKE_EXTI_UNWRITTEN in INTFR, a write by the module
+// replaces the whole value, so a missing marker at the next access means the value is the one written.
+EXTI_TypeDef *fake_exti_access(void)
+{
+    access();
+    if (!(fake_exti.INTFR & FAKE_EXTI_UNWRITTEN))
+    {
+        exti_pending &= ~fake_exti.INTFR;
+    }
+    fake_exti.INTFR = exti_pending | FAKE_EXTI_UNWRITTEN;
+    return &fake_exti;
+}
+
+void fake_exti_event(uint32_t lines)
+{
+    fake_exti_access();
+    exti_pending |= lines;
+    fake_exti.INTFR = exti_pending | FAKE_EXTI_UNWRITTEN;
+}
+
+uint32_t fake_exti_flags(void)
+{
+    fake_exti_access();
+    return exti_pending;
+}
+
+// Apply the pending BSHR writes of all ports, then sample the inputs of the accessed one.
+GPIO_TypeDef *fake_gpio_access(uint8_t port)
+{
+    access();
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        fake_gpio[i].OUTDR = (fake_gpio[i].OUTDR | (fake_gpio[i].BSHR & 0xffff)) & ~(fake_gpio[i].BSHR >> 16);
+        fake_gpio[i].BSHR  = 0;
+    }
+
+    GPIO_TypeDef *gpio = &fake_gpio[port];
+    uint32_t      indr = 0;
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        uint8_t mode  = (gpio->CFGLR >> (4 * bit)) & 0xf;
+        int     level = fake_pin_input ? fake_pin_input((port << 4) | bit) : FAKE_PIN_OPEN;
+
+        if ((mode & 0x3) != 0 || (level == FAKE_PIN_OPEN && mode == GPIO_CNF_IN_PUPD))  // Output or pull
+        {
+            level = (gpio->OUTDR >> bit) & 1;
+        }
+        indr |= (level == 1) << bit;
+    }
+    *(volatile uint32_t *)&gpio->INDR = indr;  // Read-only for the firmware
+
+    return gpio;
+}
+
+uint8_t fake_pin_output(uint8_t pin)
+{
+    return (fake_gpio_access(pin >> 4)->OUTDR >> (pin & 0xf)) & 1;
+}
+
+void fake_enable_irq(IRQn_Type irq)
+{
+    irq_enabled_mask |= (uint64_t)1 << irq;
+}
+
+void __disable_irq(void)
+{
+    irq_enabled = 0;
+}
+
+void __enable_irq(void)
+{
+    irq_enabled = 1;
+    dispatch_interrupts();
+}
+
+// Wakes up on an interrupt flag, even while interrupts are disabled, like the core does. Only SysTick and TIM1 can
+// wake it, with TIM1 stopped it skips ahead to the next SysTick compare match.
+void __WFI(void)
+{
+    uint32_t events = wake_events;
+
+    if (fake_wfi)
+    {
+        fake_wfi();
+    }
+
+    if ((fake_systick.SR & 1) || ((fake_tim1.INTFR & TIM_UIF) && (fake_tim1.DMAINTENR & TIM_UIE)))
+    {
+        return;
+    }
+
+    while (wake_events == events)
+    {
+        if (fake_tim1.CTLR1 & TIM_CEN)
+        {
+            fake_advance(1);
+        }
+        else
+        {
+            uint32_t to_match = fake_systick.CMP - fake_systick.CNT;
+            fake_advance((to_match == 0) ? ((uint64_t)1 << 32) : to_match);
+        }
+    }
+}
+
+void __WFE(void)
+{
+    if (fake_wfe)
+    {
+        fake_wfe();
+    }
+}
+
+void DelaySysTick(uint32_t n)
+{
+    fake_advance(n);
+}
+
+// Clocks and SysTick are set up by the fake peripherals' initial state.
+void SystemInit(void)
+{
+}
@@ -0,0 +1,120 @@
+#ifndef __CH32FUN_HOST_H__
+#define __CH32FUN_HOST_H__
+
+// Host build of the firmware modules, force-included ahead of every source file by test/Makefile.
+//
+// Without __riscv, ch32fun.h only provides the register layouts and bit definitions. Every peripheral the modules use
+// is remapped onto a simulated one, and every register access lets time pass, so register sequences interleave with
+// the running hardware the same way they do on the MCU.
+//
+//   HCLK     | fake_hclk, advanced by fake_advance() and by every peripheral access (fake_set_access_clocks())
+//   SysTick  | 32-bit CNT at HCLK, a CMP match sets SR, wakes __WFI() and calls SysTick_Handler() when enabled
+//   TIM1     | PSC, preloaded ATRLR/CH4CVR, UDIS, repetition counter, UG, CH4 PWM1 output, update interrupt
+//   GPIO     | INDR from fake_pin_input(), otherwise the output or the pull-up/pull-down level in OUTDR
+//   RCC      | LSI ready as soon as it is turned on
+//   EXTI     | INTFR flags from fake_exti_event(), write 1 to clear
+//   ADC, DMA | A regular scan every FAKE_ADC_SCAN_CLOCKS (TIM2 TRGO) from fake_adc_input(), DMA into MADDR, circular,
+//            | analog watchdog on a single channel, calibration done at once
+//   Others   | Plain RAM, read back as written
+//
+// Interrupts are dispatched between clocks while enabled (__enable_irq() and NVIC_EnableIRQ()), by the modules' own
+// handlers. Tests check with EXPECT() and return fake_failures from main().
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ch32fun.h"
+
+#define FAKE_PIN_OPEN        -1                                 // fake_pin_input(): the pin is not driven from outside
+#define FAKE_ADC_SCAN_CLOCKS (FUNCONF_SYSTEM_CORE_CLOCK / 200)  // TIM2 TRGO at PWM_AUX_FREQUENCY
+#define FAKE_EXTI_UNWRITTEN  (1u << 31)                          // Reserved INTFR bit, marks INTFR as not written
+
+extern uint64_t fake_hclk;
+extern uint32_t fake_failures;
+
+extern SysTick_Type  fake_systick;
+extern TIM_TypeDef   fake_tim1;
+extern TIM_TypeDef   fake_tim2;
+extern GPIO_TypeDef  fake_gpio[4];  // PA, PB (unused), PC, PD
+extern RCC_TypeDef   fake_rcc;
+extern AFIO_TypeDef  fake_afio;
+extern EXTI_TypeDef  fake_exti;
+extern PWR_TypeDef   fake_pwr;
+extern PFIC_Type     fake_pfic;
+extern ADC_TypeDef   fake_adc1;
+extern DMA_TypeDef   fake_dma1;
+extern DMA_Channel_TypeDef fake_dma1_channel1;
+extern FLASH_TypeDef fake_flash;
+
+// Test hooks, all optional
+extern int (*fake_pin_input)(uint8_t pin);                                    // Level 0/1 or FAKE_PIN_OPEN
+extern void (*fake_tim1_period)(uint32_t period_clocks, uint32_t high_clocks);  // Every finished CH4 period
+extern void (*fake_wfi)(void);  // Called by __WFI() before sleeping, e.g. to longjmp out of a sleep forever
+extern void (*fake_wfe)(void);  // __WFE(), standby, returns right away without a hook
+extern uint16_t (*fake_adc_input)(uint8_t channel);  // 10-bit conversion result
+
+void     fake_advance(uint64_t clocks);
+void     fake_set_access_clocks(uint32_t min, uint32_t max);  // HCLK per register access, random in the range
+uint32_t fake_random(void);                                   // Deterministic xorshift32
+uint8_t  fake_pin_output(uint8_t pin);
+void     fake_exti_event(uint32_t lines);  // Latch EXTI flags, e.g. the AWU or a wake pin edge in standby
+uint32_t fake_exti_flags(void);            // INTFR flags still set
+uint8_t  fake_expect(int condition, const char *text, const char *file, int line);
+
+SysTick_Type *fake_systick_access(void);
+TIM_TypeDef  *fake_tim1_access(void);
+RCC_TypeDef  *fake_rcc_access(void);
+ADC_TypeDef  *fake_adc1_access(void);
+DMA_Channel_TypeDef *fake_dma1_channel1_access(void);
+EXTI_TypeDef *fake_exti_access(void);
+GPIO_TypeDef *fake_gpio_access(uint8_t port);
+void          fake_enable_irq(IRQn_Type irq);
+void          __disable_irq(void);
+void          __enable_irq(void);
+void          __WFI(void);
+void          __WFE(void);
+void          DelaySysTick(uint32_t n);
+
+#define EXPECT(condition) fake_expect((condition), #condition, __FILE__, __LINE__)
+
+#ifdef FAKE_QUIET  // Modules that log every step, e.g. flashlight.c
+#define printf(...) (void)0
+#endif
+
+#undef SysTick
+#undef TIM1
+#undef TIM2
+#undef GPIOA
+#undef GPIOC
+#undef GPIOD
+#undef RCC
+#undef AFIO
+#undef EXTI
+#undef PWR
+#undef PFIC
+#undef NVIC
+#undef ADC1
+#undef DMA1
+#undef DMA1_Channel1
+#undef FLASH
+#undef GpioOf
+
+#define SysTick           (fake_systick_access())
+#define TIM1              (fake_tim1_access())
+#define TIM2              (&fake_tim2)
+#define GPIOA             (fake_gpio_access(0))
+#define GPIOC             (fake_gpio_access(2))
+#define GPIOD             (fake_gpio_access(3))
+#define GpioOf(pin)       (fake_gpio_access((pin) >> 4))
+#define RCC               (fake_rcc_access())
+#define AFIO              (&fake_afio)
+#define EXTI              (fake_exti_access())
+#define PWR               (&fake_pwr)
+#define PFIC              (&fake_pfic)
+#define NVIC              (&fake_pfic)
+#define ADC1              (fake_adc1_access())
+#define DMA1              (&fake_dma1)
+#define DMA1_Channel1     (fake_dma1_channel1_access())
+#define FLASH             (&fake_flash)
+#define NVIC_EnableIRQ(i) fake_enable_irq(i)
+
+#endif  // __CH32FUN_HOST_H__
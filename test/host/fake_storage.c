@@ -0,0 +1,16 @@
+#include "ch32fun_host.h"
+#include "storage.h"
+
+// Storage pages in RAM in place of flash, erased at start.
+static storage_page_t fake_pages[STORAGE_PAGE_COUNT] = {
+    [0 ... STORAGE_PAGE_COUNT - 1] = {.words = {[0 ... STORAGE_PAGE_WORDS - 1] = STORAGE_ERASED}}};
+
+const volatile storage_page_t *read_storage(uint8_t page)
+{
+    return &fake_pages[page];
+}
+
+void write_storage(uint8_t page, const storage_page_t *data)
+{
+    fake_pages[page] = *data;
+}
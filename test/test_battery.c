@@ -0,0 +1,183 @@
+#include "battery.h"
+#include "storage.h"
+
+// Battery monitor on the simulated ADC. VDD follows the supply below 3.3V (the LDO passes it through), the Vref count
+// rises as it falls. A collapse below the cutoff must be reported exactly once, the main loop cuts power on it and the
+// latch reports if that failed. Calibration must only be accepted from the calibration supply, whatever the Vref and
+// divider of the part. The division-free thresholds must decide exactly like the 32-bit mV path.
+
+#define ADC_BATTERY     ANALOG_6
+#define R_UP            100
+#define R_DOWN          100
+#define CUTOFF_MV       2800
+#define SUPPLY_MV       3000
+#define LDO_MV          3300
+#define CHECK_MV        3250
+#define CHECK_TOLERANCE_MV 10  // 1 / 372 counts at 3.3V
+#define MS_TO_CLOCKS(ms) ((uint64_t)(ms) * (FUNCONF_SYSTEM_CORE_CLOCK / 1000))
+#define RING_MS         (BATTERY_SAMPLES * 5 + 5)
+
+#define THRESHOLD_COUNT_MAX 4095  // 12-bit readings
+#define THRESHOLD_MV_MIN    1
+#define THRESHOLD_MV_MAX    4096  // is_battery_above() limit
+
+typedef struct part
+{
+    const char *name;
+    uint16_t    vref_mv;     // Actual reference of the part
+    uint16_t    r_down;      // Actual lower divider resistor, R_UP stays nominal
+    uint16_t    battery_mv;  // Calibration supply
+    uint8_t     calibrated;  // Expected
+} part_t;
+
+static const part_t parts[] = {
+    {"nominal part", 1200, R_DOWN, SUPPLY_MV, 1},
+    {"Vref +1.5%", 1218, R_DOWN, SUPPLY_MV, 1},
+    {"Vref +4%, R_DOWN +2%", 1248, 102, SUPPLY_MV, 1},
+    {"Vref -4%, R_DOWN -3%", 1152, 97, SUPPLY_MV, 1},
+    {"3.6V supply, LDO at 3.3V", 1200, R_DOWN, 3600, 0},
+    {"3.6V supply, Vref +4%", 1248, R_DOWN, 3600, 0},
+    {"4.2V battery", 1200, R_DOWN, 4200, 0},
+    {"2.6V supply", 1200, R_DOWN, 2600, 0},
+    {"Vref +8%", 1296, R_DOWN, SUPPLY_MV, 0},
+    {"divider ratio +20%", 1200, 150, SUPPLY_MV, 0},
+};
+
+static uint16_t vref_mv    = BATTERY_VREF_MV;
+static uint16_t r_down     = R_DOWN;
+static uint16_t vdd_mv     = LDO_MV;
+static uint16_t battery_mv = 3800;
+
+static uint16_t adc_input(uint8_t channel)
+{
+    uint16_t vdd = (battery_mv < vdd_mv) ? battery_mv : vdd_mv;
+
+    if (channel == ANALOG_8)
+    {
+        return ((uint32_t)vref_mv * BATTERY_ADC_FULL + vdd / 2) / vdd;
+    }
+    return ((uint32_t)battery_mv * r_down * BATTERY_ADC_FULL / (R_UP + r_down) + vdd / 2) / vdd;
+}
+
+// Exhaustive over every 12-bit count pair. is_battery_above() is monotonic in mv, so checking both sides of the
+// reference result (or the ends of the threshold range) covers every threshold.
+static void test_thresholds(void)
+{
+    const uint32_t nominal    = BATTERY_SCALE(R_UP, R_DOWN);
+    const uint32_t scales[]   = {nominal - nominal / 8, nominal, nominal + nominal / 8};
+    uint32_t       mismatches = 0;
+
+    for (uint8_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++)
+    {
+        init_battery(ADC_BATTERY, scales[i], BATTERY_VDD_MV_TO_VREF_COUNT(CUTOFF_MV));
+        for (uint16_t ref = 1; ref <= THRESHOLD_COUNT_MAX; ref++)
+        {
+            for (uint16_t mon = 0; mon <= THRESHOLD_COUNT_MAX; mon++)
+            {
+                uint32_t mv = ((uint32_t)mon * scales[i] / ref) >> BATTERY_SCALE_SHIFT;
+
+                if (mv < THRESHOLD_MV_MIN)
+                {
+                    mismatches += is_battery_above(ref, mon, THRESHOLD_MV_MIN);
+                }
+                else if (mv >= THRESHOLD_MV_MAX)
+                {
+                    mismatches += !is_battery_above(ref, mon, THRESHOLD_MV_MAX);
+                }
+                else
+                {
+                    mismatches += !is_battery_above(ref, mon, mv) + is_battery_above(ref, mon, mv + 1);
+                }
+            }
+        }
+    }
+    printf("battery: thresholds %u-%umV, every count pair, 3 scales | %u mismatches\n", THRESHOLD_MV_MIN,
+           THRESHOLD_MV_MAX, mismatches);
+    EXPECT(mismatches == 0);
+}
+
+static void test_collapse(void)
+{
+    uint16_t adc_ref;
+    uint16_t adc_mon;
+    uint8_t  collapses = 0;
+
+    read_battery(&adc_ref, &adc_mon);
+    printf("battery: %umV reads %umV\n", battery_mv, to_battery_mv(adc_ref, adc_mon));
+    EXPECT(to_battery_mv(adc_ref, adc_mon) > battery_mv - 20 && to_battery_mv(adc_ref, adc_mon) < battery_mv + 20);
+
+    fake_advance(MS_TO_CLOCKS(1000));
+    EXPECT(get_battery_event() == BATTERY_NONE);
+
+    // Sagging under load, still above the cutoff
+    battery_mv = vdd_mv = 2900;
+    fake_advance(MS_TO_CLOCKS(1000));
+    EXPECT(get_battery_event() == BATTERY_NONE);
+
+    // Collapse, then the main loop keeps waking up every 5ms
+    battery_mv = vdd_mv = 2700;
+    fake_advance(MS_TO_CLOCKS(5) + FAKE_ADC_SCAN_CLOCKS);
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+        collapses += get_battery_event() == BATTERY_COLLAPSED;
+        fake_advance(MS_TO_CLOCKS(5));
+    }
+    printf("battery: collapse to %umV reported %u time(s)\n", vdd_mv, collapses);
+    EXPECT(collapses == 1);
+}
+
+static void test_calibration(void)
+{
+    for (uint8_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+    {
+        const part_t *part = &parts[i];
+        uint16_t      adc_ref;
+        uint16_t      adc_mon;
+
+        vref_mv    = part->vref_mv;
+        r_down     = part->r_down;
+        battery_mv = part->battery_mv;
+        vdd_mv     = LDO_MV;
+        fake_advance(MS_TO_CLOCKS(RING_MS));
+
+        uint16_t cutoff     = fake_adc1.WDHTR;
+        uint8_t  calibrated = calibrate_battery(SUPPLY_MV, CUTOFF_MV);
+        read_battery(&adc_ref, &adc_mon);
+        uint16_t mv = to_battery_mv(adc_ref, adc_mon);
+
+        printf("battery: %-24s | %s, reads %4umV\n", part->name, calibrated ? "calibrated" : "refused   ", mv);
+        EXPECT(calibrated == part->calibrated);
+        if (calibrated)
+        {
+            EXPECT(mv >= SUPPLY_MV - 2 && mv <= SUPPLY_MV + 2);
+            uint16_t expected = ((uint32_t)part->vref_mv * BATTERY_ADC_FULL + CUTOFF_MV / 2) / CUTOFF_MV;
+            EXPECT(fake_adc1.WDHTR + 1 >= expected && fake_adc1.WDHTR <= expected + 1);  // 12-bit reading rounded
+            EXPECT(read_storage(STORAGE_PAGE_CALIBRATION)->words[2] == fake_adc1.WDHTR);
+
+            // The scale holds at other voltages too, within a 10-bit count, the model has no noise to oversample
+            battery_mv = CHECK_MV;
+            fake_advance(MS_TO_CLOCKS(RING_MS));
+            read_battery(&adc_ref, &adc_mon);
+            printf("battery: %-24s | reads %4umV at %umV\n", "", to_battery_mv(adc_ref, adc_mon), CHECK_MV);
+            EXPECT(to_battery_mv(adc_ref, adc_mon) + CHECK_TOLERANCE_MV >= CHECK_MV &&
+                   to_battery_mv(adc_ref, adc_mon) <= CHECK_MV + CHECK_TOLERANCE_MV);
+        }
+        else
+        {
+            EXPECT(fake_adc1.WDHTR == cutoff);
+        }
+    }
+}
+
+int main(void)
+{
+    fake_adc_input = adc_input;
+    __enable_irq();
+
+    test_thresholds();
+    init_battery(ADC_BATTERY, BATTERY_SCALE(R_UP, R_DOWN), BATTERY_VDD_MV_TO_VREF_COUNT(CUTOFF_MV));
+    test_collapse();
+    test_calibration();
+
+    return fake_failures != 0;
+}
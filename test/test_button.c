@@ -0,0 +1,126 @@
+#include "button.h"
+
+// Debounce latency of the button state machine, one get_button_event() per 5ms cycle. Press and release take the
+// first sample that sees the change plus 5 stable cycles. Without BUTTON_GESTURE_MULTI_PRESS the release event comes
+// right at the debounced release, with it only after the 250ms double click window of silence.
+
+#define PIN_BUTTON PA2
+
+#define PRESS_CYCLES       6                      // First sample down, then BUTTON_DEBOUNCE_STABLE_CYCLES
+#define RELEASE_CYCLES     6                      // First sample up, then BUTTON_DEBOUNCE_STABLE_CYCLES
+#define MULTI_PRESS_CYCLES (RELEASE_CYCLES + 51)  // Then more than BUTTON_RELEASE_STABLE_CYCLES of silence
+#define HOLD_CYCLES        200                    // Default hold delay, from the debounced press
+#define CLICK_CYCLES       20                     // 100ms down
+#define GAP_CYCLES         20                     // 100ms between the clicks of a double click
+#define CYCLES_MAX         1000
+
+static uint8_t is_down = 0;
+
+static int button_input(uint8_t pin)
+{
+    return (pin == PIN_BUTTON && is_down) ? 0 : FAKE_PIN_OPEN;
+}
+
+// Cycles up to and including the one that emits the event, no other event on the way
+static int32_t cycles_until(button_t *button, uint8_t event)
+{
+    for (int32_t cycles = 1; cycles <= CYCLES_MAX; cycles++)
+    {
+        uint8_t button_event = get_button_event(button);
+        if (button_event == event)
+        {
+            return cycles;
+        }
+        if (!EXPECT(button_event == BUTTON_NONE))
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// Cycles with no event at all, none if the event before came late
+static void run_quiet(button_t *button, int32_t cycles)
+{
+    for (; cycles > 0; cycles--)
+    {
+        EXPECT(get_button_event(button) == BUTTON_NONE);
+    }
+}
+
+static void test_click(button_t *button, uint8_t gestures, const char *name)
+{
+    set_button_gestures(button, gestures);
+
+    is_down       = 1;
+    int32_t press = cycles_until(button, BUTTON_PRESSED);
+    run_quiet(button, CLICK_CYCLES - press);
+    is_down         = 0;
+    int32_t release = cycles_until(button, BUTTON_RELEASED);
+    run_quiet(button, MULTI_PRESS_CYCLES);
+    EXPECT(is_button_idle(button));
+
+    printf("button: click, %-14s | pressed after %2d cycles (%3dms), released after %2d cycles (%3dms)\n", name, press,
+           press * BUTTON_DEBOUNCE_INTERVAL_MS, release, release * BUTTON_DEBOUNCE_INTERVAL_MS);
+    EXPECT(press == PRESS_CYCLES);
+    EXPECT(release == ((gestures & BUTTON_GESTURE_MULTI_PRESS) ? MULTI_PRESS_CYCLES : RELEASE_CYCLES));
+}
+
+static void test_hold(button_t *button, uint8_t gestures, const char *name)
+{
+    set_button_gestures(button, gestures);
+
+    is_down         = 1;
+    int32_t press   = cycles_until(button, BUTTON_PRESSED);
+    int32_t hold    = cycles_until(button, BUTTON_HOLD);
+    is_down         = 0;
+    int32_t release = cycles_until(button, BUTTON_HOLD_RELEASED);
+    run_quiet(button, MULTI_PRESS_CYCLES);
+
+    printf("button: hold, %-15s | hold after %3d cycles (%4dms), released after %2d cycles (%3dms)\n", name,
+           press + hold, (press + hold) * BUTTON_DEBOUNCE_INTERVAL_MS, release, release * BUTTON_DEBOUNCE_INTERVAL_MS);
+    EXPECT(press == PRESS_CYCLES);
+    EXPECT(hold == HOLD_CYCLES);
+    EXPECT(release == ((gestures & BUTTON_GESTURE_MULTI_PRESS) ? MULTI_PRESS_CYCLES : RELEASE_CYCLES));
+}
+
+// Two clicks GAP_CYCLES apart are a double click with BUTTON_GESTURE_MULTI_PRESS, two single clicks without it.
+static void test_double_click(button_t *button, uint8_t gestures, const char *name)
+{
+    uint8_t is_multi_press = gestures & BUTTON_GESTURE_MULTI_PRESS;
+
+    set_button_gestures(button, gestures);
+
+    is_down = 1;
+    run_quiet(button, CLICK_CYCLES - cycles_until(button, BUTTON_PRESSED));
+    is_down = 0;
+    run_quiet(button, GAP_CYCLES - (is_multi_press ? 0 : cycles_until(button, BUTTON_RELEASED)));
+    is_down = 1;
+    run_quiet(button, CLICK_CYCLES - cycles_until(button, is_multi_press ? BUTTON_DOUBLE_PRESSED : BUTTON_PRESSED));
+    is_down         = 0;
+    int32_t release = cycles_until(button, is_multi_press ? BUTTON_DOUBLE_PRESS_RELEASED : BUTTON_RELEASED);
+    run_quiet(button, MULTI_PRESS_CYCLES);
+    EXPECT(is_button_idle(button));
+
+    printf("button: double click, %-7s | %s, released after %2d cycles\n", name,
+           is_multi_press ? "one double press" : "two single presses", release);
+    EXPECT(release == (is_multi_press ? MULTI_PRESS_CYCLES : RELEASE_CYCLES));
+}
+
+int main(void)
+{
+    button_t button;
+
+    fake_pin_input = button_input;
+    init_button(&button, PIN_BUTTON);
+    EXPECT(is_button_idle(&button));
+
+    test_click(&button, BUTTON_GESTURE_NONE, "no multi-press");
+    test_click(&button, BUTTON_GESTURE_MULTI_PRESS, "multi-press");
+    test_hold(&button, BUTTON_GESTURE_NONE, "no multi-press");
+    test_hold(&button, BUTTON_GESTURE_MULTI_PRESS, "multi-press");
+    test_double_click(&button, BUTTON_GESTURE_NONE, "none");
+    test_double_click(&button, BUTTON_GESTURE_MULTI_PRESS, "multi");
+
+    return fake_failures != 0;
+}
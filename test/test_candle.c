@@ -0,0 +1,66 @@
+#include <math.h>
+#include "brightness.h"
+#include "candle.h"
+
+// Candle flicker preview. Dumps the brightness trace of CANDLE_TRACE_S seconds at each level to build/candle.csv
+// (time in ms, level, CIE L*, PWM duty), and checks what the header promises: L* stays in 1 - BRIGHTNESS_MAX, wanders
+// around the level by ~10 L*, and moves less from step to step than it deviates (lowpass).
+
+#define CANDLE_TRACE_FILE "build/candle.csv"
+#define CANDLE_TRACE_S    60
+#define CANDLE_STEPS      (CANDLE_TRACE_S * 1000 / CANDLE_STEP_MS)
+
+static const uint8_t levels[] = {12, 50, 88};
+
+int main(void)
+{
+    FILE *trace = fopen(CANDLE_TRACE_FILE, "w");
+    EXPECT(trace != NULL);
+    if (trace)
+    {
+        fprintf(trace, "ms,level,lightness,duty\n");
+    }
+
+    for (uint8_t i = 0; i < sizeof(levels); i++)
+    {
+        double  sum = 0, sum_squares = 0, sum_lag = 0;
+        uint8_t min = 255, max = 0, last = levels[i];
+
+        init_candle(0xACE1);
+        for (uint32_t step = 0; step < CANDLE_STEPS; step++)
+        {
+            uint8_t lightness = step_candle(levels[i]);
+
+            if (trace)
+            {
+                fprintf(trace, "%u,%u,%u,%u\n", step * CANDLE_STEP_MS, levels[i], lightness,
+                        cie_lookup_table[lightness]);
+            }
+            min = (lightness < min) ? lightness : min;
+            max = (lightness > max) ? lightness : max;
+            sum += lightness;
+            sum_squares += (double)lightness * lightness;
+            sum_lag += (double)(lightness - last) * (lightness - last);
+            last = lightness;
+        }
+
+        double mean     = sum / CANDLE_STEPS;
+        double variance = sum_squares / CANDLE_STEPS - mean * mean;
+        double step_rms = sqrt(sum_lag / CANDLE_STEPS);  // Step to step, small next to the deviation if lowpassed
+
+        printf("candle: level %2u | L* %3u - %3u, mean %5.1f, deviation %4.1f, step %4.1f\n", levels[i], min, max,
+               mean, sqrt(variance), step_rms);
+        EXPECT(min >= 1 && max <= BRIGHTNESS_MAX);
+        EXPECT(fabs(mean - levels[i]) < 3);
+        EXPECT(sqrt(variance) > 5 && sqrt(variance) < 15);
+        EXPECT(step_rms < sqrt(variance));
+    }
+
+    if (trace)
+    {
+        fclose(trace);
+        printf("candle: %us traces in %s\n", CANDLE_TRACE_S, CANDLE_TRACE_FILE);
+    }
+
+    return fake_failures != 0;
+}
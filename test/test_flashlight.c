@@ -0,0 +1,301 @@
+#include <ucontext.h>
+#include "battery.h"
+#include "button.h"
+#include "latch.h"
+#include "levels.h"
+#include "standby.h"
+
+// The whole firmware, main() of flashlight.c built as flashlight_main(), on its own stack. Every __WFI() of the main
+// loop hands control back to the test, which presses buttons and lets time pass, then resumes the firmware. The
+// buttons pull their pins low, the battery is a healthy 3.8V.
+
+#define PIN_LEVEL_BUTTON PA2
+#define BATTERY_MV       3800
+#define VDD_MV           3300
+#define DIVIDER_RATIO(mv) ((mv) * 3 / 5)  // POWER_VOLT_DIV_R_UP 2, POWER_VOLT_DIV_R_DOWN 3
+#define MS_TO_CLOCKS(ms)  ((uint64_t)(ms) * (FUNCONF_SYSTEM_CORE_CLOCK / 1000))
+
+enum light_modes  // flashlight.c
+{
+    MODE_STEADY,
+    MODE_MOONLIGHT,
+    MODE_CANDLE,
+    MODE_BREATHING,
+    MODE_BLINKING,
+    MODE_STROBE,
+    MODE_BEACON,
+    MODE_RHYTHM,
+    MODE_SOS,
+    MODE_OFF
+};
+
+extern uint8_t current_mode;
+extern uint8_t current_level;
+extern uint8_t current_brightness;
+int            flashlight_main(void);
+
+static ucontext_t firmware_context;
+static ucontext_t test_context;
+static uint8_t    firmware_stack[256 * 1024];
+static uint8_t    mode_down  = 0;
+static uint8_t    level_down = 0;
+static uint32_t   wake_ups   = 0;  // Every __WFI() and standby of the firmware
+static uint32_t   standby_ms = 0;  // Time in standby, HCLK stops
+static uint32_t   standbys   = 0;
+static uint64_t   led_clocks = 0;  // HCLK with the LED driver enabled
+
+static int button_input(uint8_t pin)
+{
+    if (pin == PIN_LATCH && mode_down)
+    {
+        return 0;
+    }
+    if (pin == PIN_LEVEL_BUTTON && level_down)
+    {
+        return 0;
+    }
+    return FAKE_PIN_OPEN;
+}
+
+static uint16_t adc_input(uint8_t channel)
+{
+    if (channel == ANALOG_8)
+    {
+        return (uint32_t)BATTERY_VREF_MV * BATTERY_ADC_FULL / VDD_MV;
+    }
+    return (uint32_t)DIVIDER_RATIO(BATTERY_MV) * BATTERY_ADC_FULL / VDD_MV;
+}
+
+// Firmware side, every sleep of the main loop
+static void yield_to_test(void)
+{
+    wake_ups++;
+    swapcontext(&firmware_context, &test_context);
+}
+
+// Firmware side, standby until the AWU window ends
+static void standby_awu(void)
+{
+    wake_ups++;
+    standbys++;
+    standby_ms += fake_pwr.AWUWR * STANDBY_TICK_MS;
+    fake_exti_event(EXTI_Line9);
+}
+
+static void count_led_clocks(uint32_t period_clocks, uint32_t high_clocks)
+{
+    (void)period_clocks;
+    led_clocks += high_clocks;
+}
+
+// Test side, lets the firmware run for ms of simulated time
+static void run_ms(uint32_t ms)
+{
+    uint64_t until = fake_hclk + MS_TO_CLOCKS(ms);
+
+    while (fake_hclk < until)
+    {
+        swapcontext(&test_context, &firmware_context);
+    }
+}
+
+static void press(uint8_t *button, uint32_t down_ms, uint32_t up_ms)
+{
+    *button = 1;
+    run_ms(down_ms);
+    *button = 0;
+    run_ms(up_ms);
+}
+
+static void power_on(void)
+{
+    fake_pin_input = button_input;
+    fake_adc_input = adc_input;
+    fake_wfi       = yield_to_test;
+    fake_wfe       = standby_awu;
+
+    getcontext(&firmware_context);
+    firmware_context.uc_stack.ss_sp   = firmware_stack;
+    firmware_context.uc_stack.ss_size = sizeof(firmware_stack);
+    firmware_context.uc_link          = NULL;
+    makecontext(&firmware_context, (void (*)(void))flashlight_main, 0);
+
+    swapcontext(&test_context, &firmware_context);  // Boot up to the first sleep
+    run_ms(100);
+}
+
+// Click then hold jumps to min or max in steady mode too. The hold repeats that follow must not ramp away from it,
+// only a plain hold ramps.
+static void test_click_hold(void)
+{
+    EXPECT(current_mode == MODE_STEADY && current_level == 0);
+
+    press(&level_down, 50, 100);
+    press(&level_down, 2000, 400);
+    printf("flashlight: click-hold at max     | level %u, L* %3u\n", current_level, current_brightness);
+    EXPECT(current_level == LEVEL_MAX);
+    EXPECT(current_brightness == level_table[LEVEL_MAX].steady_lightness);
+
+    press(&level_down, 50, 100);
+    press(&level_down, 2000, 400);
+    printf("flashlight: click-hold at min     | level %u, L* %3u\n", current_level, current_brightness);
+    EXPECT(current_level == 0);
+    EXPECT(current_brightness == level_table[0].steady_lightness);
+
+    press(&level_down, 1000, 400);
+    printf("flashlight: hold from L* 100      | L* %3u\n", current_brightness);
+    EXPECT(current_brightness < level_table[0].steady_lightness);
+
+    press(&level_down, 50, 100);
+    press(&level_down, 2000, 400);
+    printf("flashlight: click-hold after ramp | level %u, L* %3u\n", current_level, current_brightness);
+    EXPECT(current_brightness == level_table[current_level].steady_lightness);
+}
+
+// Wake-ups per second of every mode, each mode with its own set of running timers. The 5ms debounce timer sets a
+// floor of 200 per second while awake. The pattern timer and the moonlight burst interrupts add to it, pattern steps
+// on a multiple of 5ms share the debounce wake-up, the power monitor adds one every 5s. Only beacon gets below the
+// floor, standby between flashes stops every timer.
+
+#define WAKE_SETTLE_MS 500   // After the mode change, the Mode button click is over
+#define WAKE_WINDOW_MS 5000  // Awake time, one power monitor period
+#define WAKE_FLOOR     (1000 / BUTTON_DEBOUNCE_INTERVAL_MS)
+
+static void test_wake_ups(void)
+{
+    static const char *const mode_names[] = {"steady", "moonlight", "candle", "breathing", "blinking",
+                                             "strobe", "beacon",    "rhythm", "sos"};
+
+    for (uint8_t mode = MODE_STEADY; mode <= MODE_SOS; mode++)
+    {
+        if (mode != MODE_STEADY)
+        {
+            press(&mode_down, 50, 0);
+        }
+        run_ms(WAKE_SETTLE_MS);
+        EXPECT(current_mode == mode);
+
+        wake_ups   = 0;
+        standby_ms = 0;
+        run_ms(WAKE_WINDOW_MS);
+        uint32_t per_second = (uint64_t)wake_ups * 1000 / (WAKE_WINDOW_MS + standby_ms);
+
+        printf("flashlight: %-9s | %4u wake-ups per second, %5ums of %5ums in standby\n", mode_names[mode],
+               per_second, standby_ms, WAKE_WINDOW_MS + standby_ms);
+        if (mode == MODE_BEACON)
+        {
+            EXPECT(per_second < WAKE_FLOOR);
+        }
+        else
+        {
+            EXPECT(per_second >= WAKE_FLOOR);
+        }
+        if (mode == MODE_STEADY)  // Nothing but the debounce timer and the power monitor
+        {
+            EXPECT(per_second <= WAKE_FLOOR + 1);
+        }
+    }
+}
+
+// Beacon against MODE_BLINKING, the average current with the LED driver at FLASH_UA while the CTRL pin is high. Beacon
+// sleeps in standby between flashes, awake only for the flash and a few debounce cycles, blinking runs the MCU all the
+// time. Between flashes the MCU overhead of beacon must stay small against the flash itself.
+//
+//   I_avg = FLASH_UA x LED on / T + RUN_UA x awake / T + STANDBY_UA x standby / T
+
+#define FLASH_UA         200000  // Assumed, LED driver at full brightness
+#define RUN_UA           2600    // 6MHz on HSI, as test_lockout
+#define STANDBY_UA       10      // Standby, including the latch pull-up
+#define ENERGY_SETTLE_MS 1000  // Awake time after the last button press, not measured
+#define ENERGY_AWAKE_MS  8000  // Awake time measured, two battery indicator trains, beacon spends the rest in standby
+
+typedef struct energy
+{
+    uint32_t period_ms;  // Flash to flash, 0 without standby
+    uint32_t awake_ms;   // Per period
+    uint32_t led_ua;
+    uint32_t mcu_ua;
+} energy_t;
+
+static energy_t measure_energy(void)
+{
+    run_ms(ENERGY_SETTLE_MS);
+    led_clocks = 0;
+    standbys   = 0;
+    standby_ms = 0;
+
+    uint64_t start   = fake_hclk;
+    fake_tim1_period = count_led_clocks;
+    run_ms(ENERGY_AWAKE_MS);
+    fake_tim1_period = NULL;
+
+    uint64_t awake_us = (fake_hclk - start) / (FUNCONF_SYSTEM_CORE_CLOCK / 1000000);
+    uint64_t led_us   = led_clocks / (FUNCONF_SYSTEM_CORE_CLOCK / 1000000);
+    uint64_t total_us = awake_us + (uint64_t)standby_ms * 1000;
+    uint32_t periods  = standbys ? standbys : 1;
+
+    return (energy_t){
+        .period_ms = standbys ? total_us / 1000 / periods : 0,
+        .awake_ms  = awake_us / 1000 / periods,
+        .led_ua    = (uint64_t)FLASH_UA * led_us / total_us,
+        .mcu_ua    = ((uint64_t)RUN_UA * awake_us + (uint64_t)STANDBY_UA * standby_ms * 1000) / total_us,
+    };
+}
+
+static void print_energy(const char *name, energy_t energy)
+{
+    if (energy.period_ms)
+    {
+        printf("flashlight: %-9s | period %4ums, awake %2ums", name, energy.period_ms, energy.awake_ms);
+    }
+    else
+    {
+        printf("flashlight: %-9s | never in standby      ", name);
+    }
+    printf(" | LED %3u.%03umA + MCU %u.%03umA\n", energy.led_ua / 1000, energy.led_ua % 1000, energy.mcu_ua / 1000,
+           energy.mcu_ua % 1000);
+}
+
+static void double_click_mode(void)
+{
+    press(&mode_down, 50, 100);
+    press(&mode_down, 50, 500);
+}
+
+static void test_beacon_energy(void)
+{
+    double_click_mode();  // SOS -> rhythm -> beacon
+    double_click_mode();
+    EXPECT(current_mode == MODE_BEACON && current_level == 0);
+    energy_t beacon_fast = measure_energy();
+    print_energy("beacon 1s", beacon_fast);
+
+    press(&level_down, 1000, 500);  // Hold to the longest interval
+    EXPECT(current_level == LEVEL_MAX);
+    energy_t beacon_slow = measure_energy();
+    print_energy("beacon 5s", beacon_slow);
+
+    double_click_mode();  // Beacon -> strobe -> blinking
+    double_click_mode();
+    EXPECT(current_mode == MODE_BLINKING && current_level == 0);
+    energy_t blinking = measure_energy();
+    print_energy("blinking", blinking);
+
+    // Standby takes the MCU far below running, the flash dominates even at the longest interval
+    EXPECT(beacon_fast.mcu_ua < RUN_UA / 10);
+    EXPECT(beacon_slow.mcu_ua < RUN_UA / 50);
+    EXPECT(beacon_fast.mcu_ua < beacon_fast.led_ua / 10);
+    EXPECT(beacon_slow.mcu_ua < beacon_slow.led_ua / 10);
+    EXPECT(blinking.mcu_ua == RUN_UA);
+    EXPECT(beacon_fast.led_ua + beacon_fast.mcu_ua < (blinking.led_ua + blinking.mcu_ua) / 10);
+}
+
+int main(void)
+{
+    power_on();
+    test_click_hold();
+    test_wake_ups();
+    test_beacon_energy();
+
+    return fake_failures != 0;
+}
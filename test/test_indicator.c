@@ -0,0 +1,65 @@
+#include "indicator.h"
+#include "pwm.h"
+
+// Average current of the battery indicator, a full 4s train per bar count. update_indicator() runs once per 5ms
+// debounce cycle, the power LED is on PC1, a TIM2 hardware channel, so its duty for the cycle is the compare value.
+// The on-time integrated over the train must match the figures in indicator.h.
+
+#define PIN_POWER_LED  PC1
+#define LED_UA         1350  // Power LED fully on, indicator.h
+#define CYCLE_MS       5
+#define TRAIN_CYCLES   800   // 4s
+#define FLASH_CYCLES   10    // 50ms
+#define CLAIM_DUTY_PCT 25    // indicator.h rounds 64/255 to 25%
+#define TOLERANCE_PCT  1     // 64/255 against 25% is 0.4%
+
+static void test_battery_train(uint8_t bars)
+{
+    uint32_t duty_cycles = 0;  // Sum of the compare value over all cycles
+    uint32_t flashes     = 0;
+    uint32_t on_cycles   = 0;
+
+    // The bar count takes effect with the next train, at most one train later the window holds exactly one train
+    set_indicator_battery(bars);
+    for (uint32_t i = 0; i < TRAIN_CYCLES; i++)
+    {
+        EXPECT(update_indicator() == INDICATOR_NONE);
+    }
+
+    uint8_t was_on = fake_tim2.CH1CVR != 0;  // A flash across the window start counts at the start of the next train
+    for (uint32_t i = 0; i < TRAIN_CYCLES; i++)
+    {
+        EXPECT(update_indicator() == INDICATOR_NONE);
+
+        uint8_t duty = fake_tim2.CH1CVR;
+        duty_cycles += duty;
+        on_cycles += duty != 0;
+        flashes += duty != 0 && !was_on;
+        was_on = duty != 0;
+    }
+
+    uint32_t average_na = (uint64_t)LED_UA * 1000 * duty_cycles / PWM_AUX_DUTY_FULL / TRAIN_CYCLES;
+    uint32_t claim_na   = (uint64_t)LED_UA * 1000 * bars * FLASH_CYCLES * CLAIM_DUTY_PCT / 100 / TRAIN_CYCLES;
+
+    printf("indicator: %u bars | %u flashes, %3ums on per %ums | %2u.%03uuA, indicator.h %2u.%03uuA\n", bars, flashes,
+           on_cycles * CYCLE_MS, TRAIN_CYCLES * CYCLE_MS, average_na / 1000, average_na % 1000, claim_na / 1000,
+           claim_na % 1000);
+    EXPECT(flashes == bars);
+    EXPECT(on_cycles == bars * FLASH_CYCLES);
+    EXPECT(average_na * 100 >= claim_na * (100 - TOLERANCE_PCT));
+    EXPECT(average_na * 100 <= claim_na * (100 + TOLERANCE_PCT));
+}
+
+int main(void)
+{
+    init_pwm_aux();
+    init_indicator(add_pwm_aux_channel(PIN_POWER_LED));
+    EXPECT(is_indicator_dark());
+
+    for (uint8_t bars = INDICATOR_BARS_MAX; bars >= 1; bars--)
+    {
+        test_battery_train(bars);
+    }
+
+    return fake_failures != 0;
+}
@@ -0,0 +1,151 @@
+#include <setjmp.h>
+#include "latch.h"
+#include "lockout.h"
+#include "standby.h"
+#include "timer.h"
+
+// Bag bumps against the electronic lockout. Each bump presses the Mode button for a while, which powers the MCU up,
+// with the Level button brushed at some point or not at all, and runs the power-on path of main() up to
+// check_lockout(). A false wake must never unlock and must drop the latch right after the first released Level
+// sample. Its energy is the boot and the check at run current, then standby current until the Mode button lets go.
+
+#define PIN_LEVEL_BUTTON PA2
+
+#define SUPPLY_MV    3700
+#define RUN_UA       2600  // 6MHz on HSI, ADC and LED driver off
+#define STANDBY_UA   10    // Standby, including the latch pull-up
+#define BOOT_US      1000  // Assumed, power-on reset and startup code until main()
+#define HCLK_PER_US  (FUNCONF_SYSTEM_CORE_CLOCK / 1000000)
+#define SLACK_US     100   // Latch release after the first released Level sample
+#define RANDOM_BUMPS 1000
+
+typedef struct bump
+{
+    const char *name;
+    uint32_t    mode_us;        // Mode button down from wake-up
+    uint32_t    level_from_us;  // Level button down in [from, to) after wake-up
+    uint32_t    level_to_us;
+} bump_t;
+
+static const bump_t bumps[] = {
+    {"tap", 30000, 0, 0},
+    {"knock", 150000, 0, 0},
+    {"squeezed", 5000000, 0, 0},
+    {"level bounce", 200000, 0, 2000},
+    {"level late", 300000, 3000, 500000},
+    {"level 9.5ms", 500000, 0, LOCKOUT_CHECK_MS * 1000 - 500},
+};
+
+static const bump_t unlock = {"unlock gesture", 300000, 0, 2000000};
+
+static const bump_t *bump;
+static uint64_t      wake_hclk;
+static uint64_t      release_hclk;
+static jmp_buf       power_gone;
+
+static int press(uint8_t pin)
+{
+    uint64_t us = (fake_hclk - wake_hclk) / HCLK_PER_US;
+
+    if (pin == PIN_LATCH && us < bump->mode_us)
+    {
+        return 0;
+    }
+    if (pin == PIN_LEVEL_BUTTON && us >= bump->level_from_us && us < bump->level_to_us)
+    {
+        return 0;
+    }
+    return FAKE_PIN_OPEN;
+}
+
+// standby_forever(), nothing runs until power is gone
+static void sleep_forever(void)
+{
+    if (fake_pfic.SCTLR & (1 << 2))
+    {
+        release_hclk = fake_hclk;
+        longjmp(power_gone, 1);
+    }
+}
+
+// The power-on path of main(), returns 1 if the light would turn on.
+static uint8_t power_on(const bump_t *b)
+{
+    bump      = b;
+    wake_hclk = fake_hclk;
+    if (setjmp(power_gone))
+    {
+        return 0;
+    }
+
+    init_timer();
+    init_standby(PIN_LATCH);
+    init_latch();
+    if (is_locked_out())
+    {
+        check_lockout(PIN_LEVEL_BUTTON);
+    }
+    return 1;
+}
+
+// Energy of a false wake in uJ, from wake-up to power gone.
+static double false_wake(const bump_t *b, uint8_t print)
+{
+    uint8_t  on       = power_on(b);
+    uint32_t check_us = (release_hclk - wake_hclk) / HCLK_PER_US;
+    uint32_t run_us   = BOOT_US + check_us;
+    uint32_t level_us = (b->level_from_us == 0) ? b->level_to_us : 0;  // Held since wake-up
+    uint32_t sleep_us = (b->mode_us > run_us) ? b->mode_us - run_us : 0;
+    double   energy   = SUPPLY_MV * ((double)RUN_UA * run_us + (double)STANDBY_UA * sleep_us) / 1e9;
+
+    EXPECT(!on);
+    EXPECT(fake_pin_output(PIN_LATCH) == 0);  // Pull-down, latch off
+    EXPECT(check_us <= level_us + SLACK_US);
+    if (print)
+    {
+        printf("lockout: %-14s | run %7.3fms, standby %8.3fms, %7.2fuJ\n", b->name, run_us / 1000.0,
+               sleep_us / 1000.0, energy);
+    }
+    return energy;
+}
+
+int main(void)
+{
+    fake_pin_input = press;
+    fake_wfi       = sleep_forever;
+
+    set_lockout(1);
+    for (uint8_t i = 0; i < sizeof(bumps) / sizeof(bumps[0]); i++)
+    {
+        false_wake(&bumps[i], 1);
+    }
+
+    double energy_sum = 0;
+    double energy_max = 0;
+    for (uint32_t i = 0; i < RANDOM_BUMPS; i++)
+    {
+        bump_t random = {"random", 10000 + fake_random() % 3000000, 0, 0};
+        if (fake_random() & 1)
+        {
+            random.level_from_us = (fake_random() & 1) ? 0 : fake_random() % random.mode_us;
+            random.level_to_us   = random.level_from_us + fake_random() % 1000000;
+            if (random.level_from_us == 0)
+            {
+                random.level_to_us %= LOCKOUT_CHECK_MS * 1000 - 500;
+            }
+        }
+
+        double energy = false_wake(&random, 0);
+        energy_sum += energy;
+        energy_max = (energy > energy_max) ? energy : energy_max;
+    }
+    printf("lockout: %-14s | mean %.2fuJ, max %.2fuJ per false wake\n", "random bumps",
+           energy_sum / RANDOM_BUMPS, energy_max);
+    EXPECT(is_locked_out());
+
+    EXPECT(power_on(&unlock));
+    EXPECT(!is_locked_out());
+    printf("lockout: %-14s | unlocked\n", unlock.name);
+
+    return fake_failures != 0;
+}
@@ -0,0 +1,384 @@
+#include <string.h>
+#include "levels.h"
+#include "pwm.h"
+
+// Runt pulses. set_period_at_next_period() is called at random points of the running period, and every register access
+// takes a random number of clocks, so overflows land between any two writes. Every period on the output must be one of
+// the requested period/compare pairs, in request order, never a mix of two. The same sequence with preloading turned
+// off must show runts, or the check proves nothing.
+
+#define RUNT_REQUESTS       20000
+#define RUNT_ACCESS_CLOCKS  150   // Up to 1.5 periods at 60kHz per register access
+#define RUNT_GAP_CLOCKS     2000  // Up to 1.25 periods at 3.75kHz between requests
+
+typedef struct request
+{
+    uint16_t period_clocks;
+    uint16_t compare_clocks;
+} request_t;
+
+static request_t requests[RUNT_REQUESTS + 1];
+static uint32_t  request_count;
+static uint32_t  request_matched;  // Latest request seen on the output
+static uint32_t  periods;
+static uint32_t  mismatches;
+
+static void check_period(uint32_t period_clocks, uint32_t high_clocks)
+{
+    periods++;
+    for (uint32_t i = request_matched; i < request_count; i++)
+    {
+        uint32_t high = (requests[i].compare_clocks < requests[i].period_clocks) ? requests[i].compare_clocks
+                                                                                 : requests[i].period_clocks;
+        if (period_clocks == requests[i].period_clocks && high_clocks == high)
+        {
+            request_matched = i;
+            return;
+        }
+    }
+    mismatches++;
+}
+
+static void run_random_requests(uint8_t preload)
+{
+    request_count   = 0;
+    request_matched = 0;
+    periods         = 0;
+    mismatches      = 0;
+
+    memset(&fake_tim1, 0, sizeof(fake_tim1));  // RCC reset
+    init_pwm();
+    if (!preload)
+    {
+        fake_tim1.CTLR1 &= ~TIM_ARPE;
+        fake_tim1.CHCTLR2 &= ~TIM_OC4PE;
+    }
+
+    requests[request_count++] = (request_t){PWM_CLOCKS_FULL_DUTY_CYCLE, PWM_CLOCKS_ZERO_DUTY_CYCLE};
+    fake_tim1_period          = check_period;
+    fake_set_access_clocks(1, RUNT_ACCESS_CLOCKS);
+
+    for (uint32_t i = 0; i < RUNT_REQUESTS; i++)
+    {
+        uint16_t period_clocks  = PWM_CLOCKS_FULL_DUTY_CYCLE +
+                                 fake_random() % ((PWM_CLOCKS_FULL_DUTY_CYCLE << PWM_ADAPTIVE_MAX_SHIFT) -
+                                                  PWM_CLOCKS_FULL_DUTY_CYCLE + 1);
+        uint16_t compare_clocks = fake_random() % (period_clocks + 1);
+
+        requests[request_count++] = (request_t){period_clocks, compare_clocks};
+        set_period_at_next_period(period_clocks, compare_clocks);
+        fake_advance(fake_random() % RUNT_GAP_CLOCKS);
+    }
+
+    fake_set_access_clocks(1, 1);
+    fake_tim1_period = NULL;
+}
+
+// Strobe, every period on the output must be exactly period_ticks long with a pulse_ticks pulse at its start, in
+// PWM_STROBE_TICK_US steps. The first pulse starts on set_strobe(), set_duty_at_next_period() ends the strobe right
+// away instead of at the end of the period, up to 262ms later.
+
+#define STROBE_PERIODS       5
+#define STROBE_RESPONSE_MAX  100  // HCLK from the call to the restart of the counter, a few register accesses
+#define STROBE_HCLK_PER_TICK (FUNCONF_SYSTEM_CORE_CLOCK / 1000000 * PWM_STROBE_TICK_US)
+
+static uint32_t strobe_periods;
+static uint32_t strobe_period_clocks[STROBE_PERIODS + 2];
+static uint32_t strobe_high_clocks[STROBE_PERIODS + 2];
+static uint64_t strobe_period_end[STROBE_PERIODS + 2];
+
+static void record_period(uint32_t period_clocks, uint32_t high_clocks)
+{
+    if (strobe_periods < STROBE_PERIODS + 2)
+    {
+        strobe_period_clocks[strobe_periods] = period_clocks;
+        strobe_high_clocks[strobe_periods]   = high_clocks;
+        strobe_period_end[strobe_periods]    = fake_hclk;
+        strobe_periods++;
+    }
+}
+
+static void test_strobe(uint8_t hz, uint16_t pulse_us)
+{
+    uint16_t period_ticks = PWM_STROBE_HZ_TO_TICKS(hz);
+    uint16_t pulse_ticks  = PWM_STROBE_US_TO_TICKS(pulse_us);
+
+    memset(&fake_tim1, 0, sizeof(fake_tim1));
+    init_pwm();
+    set_duty_at_next_period(PWM_DUTY_FULL);
+    fake_advance(10 * PWM_CLOCKS_FULL_DUTY_CYCLE + 37);  // Somewhere in a PWM period
+
+    strobe_periods   = 0;
+    fake_tim1_period = record_period;
+
+    // Period 0 is the PWM period cut short by the restart
+    uint64_t start = fake_hclk;
+    set_strobe(period_ticks, pulse_ticks);
+    fake_advance((uint64_t)STROBE_PERIODS * period_ticks * STROBE_HCLK_PER_TICK);
+    EXPECT(strobe_periods == STROBE_PERIODS + 1);
+    EXPECT(strobe_period_end[0] - start < STROBE_RESPONSE_MAX);
+    for (uint32_t i = 1; i < strobe_periods; i++)
+    {
+        EXPECT(strobe_period_clocks[i] == (uint32_t)period_ticks * STROBE_HCLK_PER_TICK);
+        EXPECT(strobe_high_clocks[i] == (uint32_t)pulse_ticks * STROBE_HCLK_PER_TICK);
+    }
+
+    // Half a strobe period in, back to PWM, the strobe period is cut short
+    fake_advance(period_ticks * STROBE_HCLK_PER_TICK / 2);
+    start          = fake_hclk;
+    strobe_periods = 0;
+    set_duty_at_next_period(PWM_DUTY_FULL);
+    fake_advance(2 * PWM_CLOCKS_FULL_DUTY_CYCLE);
+    EXPECT(strobe_periods >= 2);
+    EXPECT(strobe_period_end[0] - start < STROBE_RESPONSE_MAX);
+    EXPECT(strobe_period_clocks[1] == PWM_CLOCKS_FULL_DUTY_CYCLE);
+    EXPECT(strobe_high_clocks[1] == PWM_CLOCKS_FULL_DUTY_CYCLE);
+
+    fake_tim1_period = NULL;
+    printf("pwm: strobe %uHz, %u periods of %uus with %uus pulses, starts and ends within %u clocks\n", hz,
+           STROBE_PERIODS, period_ticks * PWM_STROBE_TICK_US, pulse_ticks * PWM_STROBE_TICK_US, STROBE_RESPONSE_MAX);
+}
+
+// Adaptive frequency, every duty from 0 to PWM_DUTY_FULL on the output. Each band of the table above
+// set_duty_at_next_period() has its period, the output duty never decreases as the duty goes up and stays within half
+// a compare step of duty / 1024, and every band offers at least ~50 distinct on-times.
+
+#define SWEEP_BANDS      (PWM_ADAPTIVE_MAX_SHIFT + 1)
+#define SWEEP_STEPS_MIN  50  // Compare counts of the on-time at the bottom of a band
+#define SWEEP_SETTLE     (2 * (PWM_CLOCKS_FULL_DUTY_CYCLE << PWM_ADAPTIVE_MAX_SHIFT))  // The pair is on the output
+
+static uint32_t sweep_period_clocks;
+static uint32_t sweep_high_clocks;
+
+static void record_sweep_period(uint32_t period_clocks, uint32_t high_clocks)
+{
+    sweep_period_clocks = period_clocks;
+    sweep_high_clocks   = high_clocks;
+}
+
+static void test_duty_sweep(void)
+{
+    uint32_t steps[SWEEP_BANDS]       = {0};  // Distinct on-times per band, 0 - 60kHz
+    uint32_t fixed_steps[SWEEP_BANDS] = {0};  // The same at a fixed 60kHz
+    uint32_t previous_high            = UINT32_MAX;
+    uint32_t previous_period          = 1;
+    uint32_t previous_fixed           = UINT32_MAX;
+    uint32_t wrong                    = 0;
+
+    memset(&fake_tim1, 0, sizeof(fake_tim1));
+    init_pwm();
+    fake_tim1_period = record_sweep_period;
+
+    for (uint32_t duty = 0; duty <= PWM_DUTY_FULL; duty++)
+    {
+        uint8_t band = 0;  // Row of the table, 512 - 1023, 256 - 511, ..., 0 - 63
+        while (band < PWM_ADAPTIVE_MAX_SHIFT && duty < ((PWM_DUTY_FULL + 1) >> (band + 1)))
+        {
+            band++;
+        }
+        uint32_t period = PWM_CLOCKS_FULL_DUTY_CYCLE << band;
+
+        set_duty_at_next_period(duty);
+        fake_advance(SWEEP_SETTLE);
+
+        // Monotonic, high / period >= previous high / previous period, within half a step of duty / 1024
+        int32_t error = (int32_t)(sweep_high_clocks * 1024) - (int32_t)(duty * sweep_period_clocks);
+        wrong += sweep_period_clocks != period;
+        wrong += previous_high != UINT32_MAX &&
+                 (uint64_t)sweep_high_clocks * previous_period < (uint64_t)previous_high * sweep_period_clocks;
+        wrong += error > 512 || error < -512;
+
+        if (sweep_high_clocks != previous_high || sweep_period_clocks != previous_period)
+        {
+            steps[band]++;
+        }
+        uint32_t fixed = (PWM_CLOCKS_FULL_DUTY_CYCLE * duty + (PWM_DUTY_FULL >> 1)) >> 10;
+        if (fixed != previous_fixed)
+        {
+            fixed_steps[band]++;
+        }
+        previous_high   = sweep_high_clocks;
+        previous_period = sweep_period_clocks;
+        previous_fixed  = fixed;
+    }
+
+    fake_tim1_period = NULL;
+    for (uint8_t band = 0; band < SWEEP_BANDS; band++)
+    {
+        uint32_t low  = (band == PWM_ADAPTIVE_MAX_SHIFT) ? 0 : (PWM_DUTY_FULL + 1) >> (band + 1);
+        uint32_t high = ((PWM_DUTY_FULL + 1) >> band) - 1;
+        printf("pwm: duty %4u - %4u | %5uHz, period %4u clocks, %3u on-times, %3u at a fixed 60kHz\n", low, high,
+               PWM_FREQUENCY >> band, PWM_CLOCKS_FULL_DUTY_CYCLE << band, steps[band], fixed_steps[band]);
+        EXPECT(steps[band] >= SWEEP_STEPS_MIN);
+    }
+    printf("pwm: duty 0 - %u, %u periods wrong, not monotonic or off by more than half a step\n", PWM_DUTY_FULL,
+           wrong);
+    EXPECT(wrong == 0);
+}
+
+// Moonlight burst gating, every level of the table on the running timer. Every frame is PWM_BURST_FRAME_PERIODS
+// carrier periods, the level's on periods at PWM_BURST_COMPARE_CLOCKS first, then 0 for the rest, and the duty matches
+// the hand-written rows in levels.h. Back to steady at a random point of a frame, the burst may finish its current
+// phase, then every period is the steady pair, no runt and no period stuck high in between.
+
+#define BURST_FRAMES    4
+#define BURST_HANDOVERS 50  // Per level, at random points of the frame
+#define BURST_ACCESS_CLOCKS 20  // Widens the races, the update interrupt still ends within one 100 clock period
+#define BURST_RECORD    ((BURST_FRAMES + 2) * PWM_BURST_FRAME_PERIODS)
+
+static const level_t levels[LEVEL_COUNT] = {LEVEL_TABLE};
+
+#if LEVEL_COUNT == 8  // The moonlight rows of levels.h
+static const uint8_t  documented_on_periods[LEVEL_COUNT] = {12, 11, 9, 8, 6, 5, 3, 1};
+static const uint16_t documented_duty_milli[LEVEL_COUNT] = {100, 92, 75, 67, 50, 42, 25, 8};  // 0.001%
+#endif
+
+static uint32_t burst_periods;
+static uint16_t burst_period_clocks[BURST_RECORD];
+static uint16_t burst_high_clocks[BURST_RECORD];
+
+static void record_burst_period(uint32_t period_clocks, uint32_t high_clocks)
+{
+    if (burst_periods < BURST_RECORD)
+    {
+        burst_period_clocks[burst_periods] = period_clocks;
+        burst_high_clocks[burst_periods]   = high_clocks;
+        burst_periods++;
+    }
+}
+
+static uint8_t is_burst_period(uint32_t i)
+{
+    return burst_period_clocks[i] == PWM_CLOCKS_FULL_DUTY_CYCLE &&
+           (burst_high_clocks[i] == PWM_BURST_COMPARE_CLOCKS || burst_high_clocks[i] == PWM_CLOCKS_ZERO_DUTY_CYCLE);
+}
+
+// Periods of the frames that follow the first on period, 0 if they all match the level
+static uint32_t check_burst_frames(uint8_t on_periods, uint32_t *high_clocks, uint32_t *period_clocks)
+{
+    uint32_t first = 0;
+    uint32_t wrong = 0;
+
+    while (first < burst_periods && burst_high_clocks[first] != PWM_BURST_COMPARE_CLOCKS)
+    {
+        first++;
+    }
+    EXPECT(first + BURST_FRAMES * PWM_BURST_FRAME_PERIODS <= burst_periods);
+    for (uint32_t i = first; i < first + BURST_FRAMES * PWM_BURST_FRAME_PERIODS && i < burst_periods; i++)
+    {
+        uint32_t high = ((i - first) % PWM_BURST_FRAME_PERIODS < on_periods) ? PWM_BURST_COMPARE_CLOCKS
+                                                                              : PWM_CLOCKS_ZERO_DUTY_CYCLE;
+        wrong += burst_period_clocks[i] != PWM_CLOCKS_FULL_DUTY_CYCLE || burst_high_clocks[i] != high;
+        *high_clocks += burst_high_clocks[i];
+        *period_clocks += burst_period_clocks[i];
+    }
+    return wrong;
+}
+
+static void test_burst(void)
+{
+    uint32_t handover_max = 0;
+
+    memset(&fake_tim1, 0, sizeof(fake_tim1));
+    init_pwm();
+    __enable_irq();
+    fake_tim1_period = record_burst_period;
+    fake_set_access_clocks(1, BURST_ACCESS_CLOCKS);
+
+    for (uint8_t l = 0; l < LEVEL_COUNT; l++)
+    {
+        uint8_t  on_periods    = levels[l].moonlight_on_periods;
+        uint32_t high_clocks   = 0;
+        uint32_t period_clocks = 0;
+        uint32_t wrong         = 0;
+
+        for (uint32_t h = 0; h < BURST_HANDOVERS; h++)
+        {
+            burst_periods = 0;
+            set_burst_at_next_period(on_periods);
+            fake_advance((BURST_FRAMES + 1) * PWM_BURST_FRAME_PERIODS * PWM_CLOCKS_FULL_DUTY_CYCLE +
+                         fake_random() % (PWM_BURST_FRAME_PERIODS * PWM_CLOCKS_FULL_DUTY_CYCLE));
+            wrong += check_burst_frames(on_periods, &high_clocks, &period_clocks);
+
+            // Steady, the pair written to the preload registers is the one on the output from the first period that
+            // is not a burst period on
+            burst_periods = 0;
+            set_duty_at_next_period(levels[l].steady_duty);
+            uint32_t steady_period  = fake_tim1.ATRLR + 1;
+            uint32_t steady_high    = (fake_tim1.CH4CVR < steady_period) ? fake_tim1.CH4CVR : steady_period;
+            uint32_t steady_periods = (PWM_BURST_FRAME_PERIODS + 2) * PWM_CLOCKS_FULL_DUTY_CYCLE / steady_period;
+            fake_advance((uint64_t)PWM_BURST_FRAME_PERIODS * PWM_CLOCKS_FULL_DUTY_CYCLE +
+                         (uint64_t)(steady_periods + 2) * steady_period);
+
+            uint32_t handover = 0;
+            while (handover < burst_periods && is_burst_period(handover) &&
+                   !(burst_period_clocks[handover] == steady_period && burst_high_clocks[handover] == steady_high))
+            {
+                handover++;
+            }
+            EXPECT(handover <= PWM_BURST_FRAME_PERIODS);
+            handover_max = (handover > handover_max) ? handover : handover_max;
+            EXPECT(burst_periods > handover + 2);
+            for (uint32_t i = handover; i < burst_periods; i++)
+            {
+                wrong += burst_period_clocks[i] != steady_period || burst_high_clocks[i] != steady_high;
+            }
+        }
+
+        // Duty in 0.001%, rounded
+        uint32_t duty_milli = ((uint64_t)high_clocks * 100000 + period_clocks / 2) / period_clocks;
+        printf("pwm: moonlight level %u, %2u of %u periods on, duty %u.%03u%%, %u wrong periods\n", l, on_periods,
+               PWM_BURST_FRAME_PERIODS, duty_milli / 1000, duty_milli % 1000, wrong);
+        EXPECT(wrong == 0);
+#if LEVEL_COUNT == 8
+        EXPECT(on_periods == documented_on_periods[l]);
+        EXPECT(duty_milli == documented_duty_milli[l]);
+#endif
+    }
+
+    fake_set_access_clocks(1, 1);
+    fake_tim1_period = NULL;
+    printf("pwm: moonlight to steady after at most %u burst periods, no runt or stuck-high period\n", handover_max);
+}
+
+// Auxiliary channels, one more than PWM_AUX_CHANNELS_MAX is refused and its duty ignored.
+static void test_aux_channels(void)
+{
+    static const uint8_t pins[] = {PC1, PD3, PC0, PD4, PD5};
+
+    init_pwm_aux();
+    for (uint8_t i = 0; i < PWM_AUX_CHANNELS_MAX; i++)
+    {
+        EXPECT(add_pwm_aux_channel(pins[i]) == i);
+    }
+    EXPECT(add_pwm_aux_channel(pins[PWM_AUX_CHANNELS_MAX]) == PWM_AUX_CHANNEL_INVALID);
+    set_pwm_aux_duty(PWM_AUX_CHANNEL_INVALID, PWM_AUX_DUTY_FULL);
+    set_pwm_aux_duty(0, PWM_AUX_DUTY_FULL);
+    EXPECT(fake_tim2.CH1CVR == PWM_AUX_DUTY_FULL);
+    printf("pwm: %u auxiliary channels, the next one refused\n", PWM_AUX_CHANNELS_MAX);
+}
+
+int main(void)
+{
+    run_random_requests(1);
+    printf("pwm: %u random requests, %u periods, %u runt or mixed\n", RUNT_REQUESTS, periods, mismatches);
+    EXPECT(mismatches == 0);
+    EXPECT(periods > RUNT_REQUESTS);
+
+    run_random_requests(0);
+    printf("pwm: without preload, %u of %u periods runt or mixed\n", mismatches, periods);
+    EXPECT(mismatches > 0);
+
+    test_duty_sweep();
+
+    test_strobe(5, 2000);
+    test_strobe(12, 2000);
+    test_strobe(20, 2000);
+    test_strobe(20, 100);
+
+    test_burst();
+
+    test_aux_channels();
+
+    return fake_failures != 0;
+}
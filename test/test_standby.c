@@ -0,0 +1,67 @@
+#include "standby.h"
+
+// Wake sources of enter_standby(). The WFE stands for the standby period, the hook sets the EXTI flags and the pin
+// level the hardware would leave behind. The Mode button may already be released when the code runs again, the
+// source must come from the flags, not the pin. Flags left from before are cleared on entry, the wake flags after
+// wake-up, or the next standby would report a stale source.
+
+#define PIN_WAKE PC2
+
+typedef struct wake
+{
+    const char *name;
+    uint32_t    flags;       // EXTI->INTFR latched in standby
+    uint8_t     pin_level;    // Wake pin level after wake-up
+    uint8_t     wake_source;  // Expected
+} wake_t;
+
+static const wake_t wakes[] = {
+    {"AWU window ended", EXTI_Line9, 1, STANDBY_WAKE_TIMER},
+    {"Mode pressed", 1 << (PIN_WAKE & 0xf), 0, STANDBY_WAKE_PIN},
+    {"Mode bounced, released", 1 << (PIN_WAKE & 0xf), 1, STANDBY_WAKE_PIN},
+    {"Mode at the window end", EXTI_Line9 | (1 << (PIN_WAKE & 0xf)), 0, STANDBY_WAKE_TIMER},
+    {"early WFE return", 0, 1, STANDBY_WAKE_OTHER},
+    {"early WFE, Mode held", 0, 0, STANDBY_WAKE_OTHER},
+};
+
+static const char *source_names[] = {"STANDBY_WAKE_TIMER", "STANDBY_WAKE_PIN", "STANDBY_WAKE_OTHER"};
+
+static const wake_t *wake;
+
+static void standby(void)
+{
+    EXPECT(fake_pfic.SCTLR & (1 << 2));  // SLEEPDEEP
+    EXPECT(fake_pwr.CTLR & PWR_CTLR_PDDS);
+    EXPECT(fake_exti_flags() == 0);
+    fake_exti_event(wake->flags);
+}
+
+static int pin_level(uint8_t pin)
+{
+    return (pin == PIN_WAKE) ? wake->pin_level : FAKE_PIN_OPEN;
+}
+
+int main(void)
+{
+    fake_wfe       = standby;
+    fake_pin_input = pin_level;
+
+    init_standby(PIN_WAKE);
+    EXPECT(fake_exti.EVENR & EXTI_Line9);
+    EXPECT(fake_exti.FTENR & (1 << (PIN_WAKE & 0xf)));
+
+    for (uint8_t i = 0; i < sizeof(wakes) / sizeof(wakes[0]); i++)
+    {
+        wake = &wakes[i];
+        fake_exti_event(EXTI_Line9 | (1 << (PIN_WAKE & 0xf)));  // Latched while awake
+        uint8_t source = enter_standby(STANDBY_MS_TO_TICKS(1000));
+
+        printf("standby: %-22s | %s\n", wake->name, source_names[source]);
+        EXPECT(source == wake->wake_source);
+        EXPECT(!(fake_pfic.SCTLR & (1 << 2)));
+        EXPECT(!(fake_pwr.CTLR & PWR_CTLR_PDDS));
+        EXPECT(fake_exti_flags() == 0);
+    }
+
+    return fake_failures != 0;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+#include "timer.h"
+
+// Soft timers on the simulated SysTick, the modules' own SysTick_Handler() clears the compare flag.
+
+#define RACE_WAKES         100000
+#define RACE_ACCESS_CLOCKS 100   // Per register access, CNT passes close deadlines while CMP is being written
+#define RACE_MAX_LATE      2000  // Ticks, a few register accesses
+
+#define DRIFT_HOURS       24
+#define DRIFT_PERIOD_MS   5     // The debounce cycle
+#define DRIFT_LATE_ODDS   1000  // One in 1000 expiries is handled 1-3 periods late
+#define DRIFT_MAX_LATE    200   // Ticks, any other expiry
+
+// Timers on the stack are unlinked when they stop, a later sleep must not walk into the dead frames.
+static void __attribute__((noinline)) run_stack_timer(uint8_t stop_early)
+{
+    soft_timer_t timer;
+    memset(&timer, 0xA5, sizeof(timer));
+
+    start_timer(&timer, 5, 0);
+    if (stop_early)
+    {
+        stop_timer(&timer);
+        return;
+    }
+    while (!is_timer_expired(&timer))
+    {
+        sleep_until_next_timer();
+    }
+}
+
+static void __attribute__((noinline)) clobber_stack(void)
+{
+    volatile uint8_t junk[512];
+    memset((void *)junk, 0x5A, sizeof(junk));
+}
+
+static void test_stack_timers(void)
+{
+    static soft_timer_t timer;
+
+    run_stack_timer(1);
+    run_stack_timer(0);
+    clobber_stack();
+
+    start_timer(&timer, 10, 0);
+    uint64_t start = get_timer_ticks();
+    while (!is_timer_expired(&timer))
+    {
+        sleep_until_next_timer();
+    }
+    uint64_t slept = get_timer_ticks() - start;
+
+    printf("timer: stack timers unlinked, slept %llu ticks for 10ms\n", (unsigned long long)slept);
+    EXPECT(slept >= 10 * TIMER_TICKS_PER_MS && slept < 10 * TIMER_TICKS_PER_MS + RACE_MAX_LATE);
+}
+
+// Random work after every expiry puts the next deadline anywhere from far away to right at the minimum sleep. When
+// CNT passes CMP before the write lands, there is no compare match until the counter wraps, the sleep must be skipped.
+static void test_sleep_race(void)
+{
+    static soft_timer_t timer;
+    uint64_t            late_max = 0;
+    uint32_t            close    = 0;
+
+    fake_set_access_clocks(1, RACE_ACCESS_CLOCKS);
+    start_timer(&timer, 1, 1);
+    for (uint32_t i = 0; i < RACE_WAKES; i++)
+    {
+        is_timer_expired(&timer);
+        fake_advance(fake_random() % TIMER_TICKS_PER_MS);  // Work
+
+        // On the HCLK of the simulation, a sleep over a whole counter wrap is invisible to get_timer_ticks()
+        uint64_t now = get_timer_ticks();
+        uint64_t due = fake_hclk;  // Already due, must not sleep
+        if (timer.deadline > now)
+        {
+            due += timer.deadline - now;
+            close += (timer.deadline - now < 4 * RACE_ACCESS_CLOCKS);
+        }
+        sleep_until_next_timer();
+
+        if (fake_hclk > due && fake_hclk - due > late_max)
+        {
+            late_max = fake_hclk - due;
+        }
+    }
+    stop_timer(&timer);
+    fake_set_access_clocks(1, 1);
+
+    printf("timer: %u sleeps, %u within %u ticks of the deadline, latest wake-up %llu ticks\n", RACE_WAKES, close,
+           4 * RACE_ACCESS_CLOCKS, (unsigned long long)late_max);
+    EXPECT(close > 0);
+    EXPECT(late_max < RACE_MAX_LATE);
+}
+
+// A periodic timer over 24 hours, ~120 SysTick wraps. The 64-bit tick must match the simulated HCLK exactly, and the
+// deadline must still be on the original schedule, a whole number of periods from the first one. Handling an expiry
+// late skips the missed ones instead of shifting the schedule.
+static void test_drift(void)
+{
+    static soft_timer_t timer;
+    const uint64_t      period_ticks = DRIFT_PERIOD_MS * TIMER_TICKS_PER_MS;
+    uint64_t            tick_start   = get_timer_ticks();
+    uint64_t            hclk_start   = fake_hclk;
+    uint64_t            hclk_end     = hclk_start + (uint64_t)DRIFT_HOURS * 3600 * 1000 * TIMER_TICKS_PER_MS;
+    uint64_t            expiries     = 0;
+    uint32_t            late         = 0;
+    uint64_t            late_max     = 0;
+    uint8_t             was_late     = 0;
+
+    fake_set_access_clocks(1, 20);
+    start_timer(&timer, DRIFT_PERIOD_MS, DRIFT_PERIOD_MS);
+    uint64_t first_deadline = timer.deadline;
+
+    while (fake_hclk < hclk_end)
+    {
+        uint64_t deadline = timer.deadline;
+        if (is_timer_expired(&timer))
+        {
+            uint64_t lateness = get_timer_ticks() - deadline;
+            if (!was_late && lateness > late_max)
+            {
+                late_max = lateness;
+            }
+            expiries++;
+
+            was_late = (fake_random() % DRIFT_LATE_ODDS == 0);
+            if (was_late)
+            {
+                fake_advance((1 + fake_random() % 3) * period_ticks);
+                late++;
+            }
+        }
+        sleep_until_next_timer();
+    }
+
+    uint64_t ticks   = get_timer_ticks();
+    uint64_t hclk    = fake_hclk;
+    uint64_t periods = (timer.deadline - first_deadline) / period_ticks;
+    stop_timer(&timer);
+    fake_set_access_clocks(1, 1);
+
+    printf("timer: %uh, %llu wraps, %llu expiries, %u handled late, %llu skipped, latest on time %llu ticks\n",
+           DRIFT_HOURS, (unsigned long long)((hclk - hclk_start) >> 32), (unsigned long long)expiries, late,
+           (unsigned long long)(periods - expiries), (unsigned long long)late_max);
+    EXPECT(ticks - tick_start == hclk - hclk_start);
+    EXPECT((timer.deadline - first_deadline) % period_ticks == 0);
+    EXPECT(timer.deadline + DRIFT_MAX_LATE > ticks && timer.deadline <= ticks + period_ticks);
+    EXPECT(late_max < DRIFT_MAX_LATE);
+    EXPECT(periods - expiries <= 3 * late);
+}
+
+int main(void)
+{
+    init_timer();
+
+    test_stack_timers();
+    test_sleep_race();
+    test_drift();
+
+    return fake_failures != 0;
+}
@@ -0,0 +1,138 @@
+#include "timer.h"
+
+#define TIMER_MIN_SLEEP_TICKS 60  // 10us, not worth sleeping for less
+
+static soft_timer_t *timer_list      = NULL;
+static uint32_t      timer_ticks_high = 0;  // Upper 32 bits of the monotonic tick
+static uint32_t      timer_ticks_low  = 0;  // Last SysTick->CNT read, a smaller value means the counter wrapped
+static uint64_t      timer_ticks_skew = 0;  // Time SysTick did not count, e.g. in standby
+
+void SysTick_Handler(void) __attribute__((interrupt));
+void SysTick_Handler(void)
+{
+    SysTick->SR = 0;  // Wake-up only, the work is done by the main loop
+}
+
+void init_timer(void)
+{
+    // SysTick->CNT has been running since SystemInit(), only the compare interrupt is added.
+    SysTick->SR   = 0;
+    SysTick->CTLR = SYSTICK_CTLR_STE | SYSTICK_CTLR_STIE | SYSTICK_CTLR_STCLK;
+    NVIC_EnableIRQ(SysTicK_IRQn);
+}
+
+// Main loop only, the wrap bookkeeping is not interrupt safe.
+uint64_t get_timer_ticks(void)
+{
+    uint32_t count = SysTick->CNT;
+    if (count < timer_ticks_low)
+    {
+        timer_ticks_high++;
+    }
+    timer_ticks_low = count;
+    return (((uint64_t)timer_ticks_high << 32) | count) + timer_ticks_skew;
+}
+
+void advance_timer_ticks(uint32_t ms)
+{
+    timer_ticks_skew += (uint64_t)ms * TIMER_TICKS_PER_MS;
+}
+
+static void unlink_timer(soft_timer_t *timer)
+{
+    for (soft_timer_t **link = &timer_list; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == timer)
+        {
+            *link = timer->next;
+            break;
+        }
+    }
+}
+
+void start_timer(soft_timer_t *timer, uint32_t delay_ms, uint32_t period_ms)
+{
+    soft_timer_t *registered = timer_list;
+    while (registered != NULL && registered != timer)
+    {
+        registered = registered->next;
+    }
+    if (registered == NULL)
+    {
+        timer->next = timer_list;
+        timer_list  = timer;
+    }
+
+    timer->deadline     = get_timer_ticks() + delay_ms * TIMER_TICKS_PER_MS;
+    timer->period_ticks = period_ms * TIMER_TICKS_PER_MS;
+    timer->is_running   = 1;
+}
+
+void stop_timer(soft_timer_t *timer)
+{
+    unlink_timer(timer);
+    timer->is_running = 0;
+}
+
+// Returns 1 once per expiry. A periodic timer is re-armed from its own deadline, if the caller fell more than a period
+// behind, it skips the missed expiries instead of firing them back to back, and stays on the original schedule.
+uint8_t is_timer_expired(soft_timer_t *timer)
+{
+    uint64_t now = get_timer_ticks();
+
+    if (!timer->is_running || now < timer->deadline)
+    {
+        return 0;
+    }
+
+    if (timer->period_ticks == 0)
+    {
+        stop_timer(timer);
+    }
+    else
+    {
+        do
+        {
+            timer->deadline += timer->period_ticks;
+        } while (timer->deadline <= now);
+    }
+
+    return 1;
+}
+
+// Sleep until the nearest deadline of all running timers, or any other interrupt. Returns right away if a timer is
+// already due. Interrupts are masked while CMP is programmed, so a compare match before the WFI stays pending and wakes
+// it up instead of being lost.
+//
+// The match is on CNT == CMP. If CNT has already passed the new CMP when it is written (the deadline was close and
+// the code got delayed, e.g. by a flash write stalling the core), there is no match until the counter wraps ~715s
+// later. SR is cleared before CMP is written, and CNT is checked against CMP afterwards, so the WFI is skipped then.
+void sleep_until_next_timer(void)
+{
+    uint64_t nearest_deadline = UINT64_MAX;
+
+    __disable_irq();
+
+    for (soft_timer_t *timer = timer_list; timer != NULL; timer = timer->next)
+    {
+        if (timer->deadline < nearest_deadline)
+        {
+            nearest_deadline = timer->deadline;
+        }
+    }
+
+    // Capped at half a counter wrap, so get_timer_ticks() never misses a wrap.
+    uint64_t now = get_timer_ticks();
+    if (nearest_deadline > now + TIMER_MIN_SLEEP_TICKS)
+    {
+        uint32_t sleep_ticks = (nearest_deadline - now > INT32_MAX) ? INT32_MAX : (uint32_t)(nearest_deadline - now);
+        SysTick->SR          = 0;
+        SysTick->CMP         = timer_ticks_low + sleep_ticks;
+        if ((int32_t)(SysTick->CNT - SysTick->CMP) < 0)
+        {
+            __WFI();
+        }
+    }
+
+    __enable_irq();
+}
@@ -0,0 +1,49 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "ch32fun.h"
+
+// Tickless Soft Timers
+//
+// One-shot and periodic timers on a monotonic 64-bit tick (HCLK, 6MHz), extended in software from the free-running
+// 32-bit SysTick counter, which is never reset. A running timer is linked into the scheduler list,
+// sleep_until_next_timer() programs SysTick->CMP to the nearest deadline and sleeps, the SysTick interrupt only wakes
+// the CPU up. All work runs in the main loop when is_timer_expired() says it is due.
+//
+//   start_timer(&timer, 500, 0)   | One-shot, expires once 500ms from now, then stops
+//   start_timer(&timer, 5, 5)     | Periodic, expires every 5ms, deadlines advance by the period without drift
+//
+//   while (1)
+//   {
+//       if (is_timer_expired(&a)) { ... }
+//       if (is_timer_expired(&b)) { ... }
+//       sleep_until_next_timer();
+//   }
+//
+// Deadlines are absolute 64-bit ticks and never wrap. A periodic timer advances by whole periods from its own
+// deadline, so late handling shows up as jitter of one expiry, never as cumulative drift. get_timer_ticks() must be
+// called at least once per counter wrap (~715s at 6MHz) to catch the wrap, sleep_until_next_timer() never sleeps
+// longer than half of it. SysTick stops in standby, advance_timer_ticks() adds the time spent there.
+//
+// Timers are unlinked when they stop, by stop_timer() or the expiry of a one-shot. A running timer must outlive its
+// registration, give timers static storage, or stop them before they go out of scope.
+
+#define TIMER_TICKS_PER_MS (FUNCONF_SYSTEM_CORE_CLOCK / 1000)
+
+typedef struct soft_timer
+{
+    uint64_t           deadline;      // Absolute tick of the next expiry
+    uint32_t           period_ticks;  // 0 - one-shot
+    uint8_t            is_running;
+    struct soft_timer *next;          // Scheduler list, only while running
+} soft_timer_t;
+
+void     init_timer(void);
+uint64_t get_timer_ticks(void);
+void     advance_timer_ticks(uint32_t ms);
+void     start_timer(soft_timer_t *timer, uint32_t delay_ms, uint32_t period_ms);
+void     stop_timer(soft_timer_t *timer);
+uint8_t  is_timer_expired(soft_timer_t *timer);
+void     sleep_until_next_timer(void);
+
+#endif  // __TIMER_H__